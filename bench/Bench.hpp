@@ -0,0 +1,67 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// Commit the binary was built from, set by bench/Makefile
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+namespace bench {
+
+// Written by every benchmark so the optimizer can't drop the work
+extern volatile float sink;
+// Only benchmarks whose name contains this run, all of them when null
+extern const char *filter;
+
+// Prints one JSON result line
+inline void report(const char *name, float sampleRate, double nsPerSample) {
+  std::printf("{\"bench\": \"%s\", \"sampleRate\": %g, \"nsPerSample\": %.3f, "
+              "\"samplesPerSecond\": %.0f, \"revision\": \"%s\"}\n",
+              name, sampleRate, nsPerSample, 1e9 / nsPerSample,
+              BENCH_REVISION);
+  std::fflush(stdout);
+}
+
+// Prints one JSON line with a measured quality instead of a cost
+inline void reportValue(const char *name, float sampleRate, const char *key,
+                        double value) {
+  std::printf("{\"bench\": \"%s\", \"sampleRate\": %g, \"%s\": %.6g, "
+              "\"revision\": \"%s\"}\n",
+              name, sampleRate, key, value, BENCH_REVISION);
+  std::fflush(stdout);
+}
+
+/**
+ * Calls `fn` until `minSeconds` have elapsed, where each call processes
+ * `framesPerCall` frames, and prints one JSON line with the cost per frame.
+ */
+template <typename F>
+void run(const char *name, float sampleRate, int framesPerCall, F fn,
+         double minSeconds = 0.25) {
+  if (filter && !std::strstr(name, filter))
+    return;
+  typedef std::chrono::steady_clock clock;
+  for (int i = 0; i < 64; i++)
+    fn();
+
+  long long frames = 0;
+  double elapsed = 0.0;
+  clock::time_point start = clock::now();
+  do {
+    for (int i = 0; i < 64; i++)
+      fn();
+    frames += 64LL * framesPerCall;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < minSeconds);
+
+  report(name, sampleRate, elapsed * 1e9 / (double)frames);
+}
+
+void delaySuite();
+void kernelSuite();
+void engineSuite();
+void tapBankSuite();
+
+} // namespace bench
@@ -0,0 +1,81 @@
+#include "Bench.hpp"
+#include "DelayProcessor.hpp"
+#include "LegacyDelay.hpp"
+#include <memory>
+#include <string>
+
+// Read + write cost of the four tap delay lines, per frame, for the original
+// vector layout and the paged interleaved ring.
+
+static const int NUM_TAPS = 4;
+static const int BLOCK = 32;
+static const size_t MAX_DELAY_SAMPLES = 192000 * 10;
+static const float TAP_TIMES[NUM_TAPS] = {0.35f, 0.45f, 0.55f, 0.65f};
+static const char *INTERPOLATIONS[paisa::DelayProcessor::NUM_INTERPOLATIONS] = {
+    "linear", "lagrange3", "hermite", "allpass", "sinc"};
+
+void bench::delaySuite() {
+  for (float sampleRate : {44100.f, 48000.f, 96000.f, 192000.f}) {
+    {
+      std::unique_ptr<LegacyDelay> taps[NUM_TAPS];
+      for (int t = 0; t < NUM_TAPS; t++) {
+        taps[t].reset(new LegacyDelay(MAX_DELAY_SAMPLES));
+        taps[t]->setTime(TAP_TIMES[t]);
+      }
+      float x = 0.f;
+      run("delay/legacy", sampleRate, 1, [&]() {
+        for (int t = 0; t < NUM_TAPS; t++) {
+          float l, r;
+          taps[t]->read(l, r, sampleRate);
+          taps[t]->write(x + l * 0.5f, x - r * 0.5f);
+          x = l;
+        }
+        sink = x;
+      });
+    }
+
+    std::unique_ptr<paisa::DelayProcessor> taps[NUM_TAPS];
+    for (int t = 0; t < NUM_TAPS; t++) {
+      taps[t].reset(new paisa::DelayProcessor(MAX_DELAY_SAMPLES));
+      taps[t]->setParams(TAP_TIMES[t], 0.5f);
+      taps[t]->reserve(sampleRate);
+    }
+
+    float x = 0.f;
+    run("delay/paged", sampleRate, 1, [&]() {
+      for (int t = 0; t < NUM_TAPS; t++) {
+        float l, r;
+        taps[t]->read(l, r, sampleRate);
+        taps[t]->write(x + l * 0.5f, x - r * 0.5f);
+        x = l;
+      }
+      sink = x;
+    });
+
+    float bufL[BLOCK], bufR[BLOCK];
+    run("delay/paged-block", sampleRate, BLOCK, [&]() {
+      for (int t = 0; t < NUM_TAPS; t++) {
+        taps[t]->readBlock(bufL, bufR, BLOCK, sampleRate);
+        for (int i = 0; i < BLOCK; i++)
+          taps[t]->write(bufL[i] * 0.5f, bufR[i] * 0.5f);
+      }
+      sink = bufL[0];
+    });
+
+    // Cost of each kernel, same blocks of 32
+    for (int mode = 0; mode < paisa::DelayProcessor::NUM_INTERPOLATIONS;
+         mode++) {
+      for (int t = 0; t < NUM_TAPS; t++)
+        taps[t]->setInterpolation(mode);
+      std::string name = std::string("delay/interp-") + INTERPOLATIONS[mode];
+      run(name.c_str(), sampleRate, BLOCK, [&]() {
+        for (int t = 0; t < NUM_TAPS; t++) {
+          taps[t]->readBlock(bufL, bufR, BLOCK, sampleRate);
+          for (int i = 0; i < BLOCK; i++)
+            taps[t]->write(bufL[i] * 0.5f, bufR[i] * 0.5f);
+        }
+        sink = bufL[0];
+      });
+    }
+  }
+}
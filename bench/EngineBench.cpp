@@ -0,0 +1,166 @@
+#include "Bench.hpp"
+#include "Denormals.hpp"
+#include "MultitapEngine.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+// All of the DSP in Multitap_delay::process(), i.e. the engine with the
+// taps and the default reverb, per frame, from one voice to full polyphony
+
+static void runEngine(const char *name, float sampleRate, int channels) {
+  paisa::MultitapEngine engine;
+  engine.setChannels(channels);
+  paisa::MultitapEngine::Params params;
+  for (int t = 0; t < paisa::MultitapEngine::NUM_TAPS; t++) {
+    params.taps[t][0][0] = 0.35f + 0.1f * t;
+    params.taps[t][0][1] = 0.5f;
+    params.taps[t][3][0] = 0.3f;
+    params.taps[t][3][1] = 0.8f;
+  }
+  engine.publish(params);
+  engine.reserve(sampleRate, engine.getLineMode());
+
+  float in[paisa::MultitapEngine::MAX_CHANNELS];
+  paisa::MultitapEngine::Frame frame;
+  int n = 0;
+  bench::run(name, sampleRate, 1, [&]() {
+    for (int c = 0; c < channels; c++)
+      in[c] = (n++ & 1023) < 64 ? 0.5f : 0.f;
+    engine.process(in, in, sampleRate, frame);
+    bench::sink = frame.sumL;
+  });
+}
+
+// Switching from the default reverb, with a fade long enough to last the
+// whole run. The /extra line is what the engine's crossfade counter puts
+// on top of running only the new reverb.
+static void runCrossfade(const char *name, float sampleRate, int mode) {
+  paisa::MultitapEngine engine(paisa::MultitapEngine::REVERB_DEFAULT,
+                               sampleRate);
+  engine.publish(paisa::MultitapEngine::Params());
+  engine.reserve(sampleRate, engine.getLineMode());
+  engine.setReverbFadeTime(1e6f);
+  engine.setReverbMode(mode);
+
+  paisa::MultitapEngine::Frame frame;
+  int n = 0;
+  bench::run(name, sampleRate, 1, [&]() {
+    float in = (n++ & 1023) < 64 ? 0.5f : 0.f;
+    engine.process(in, in, sampleRate, frame);
+    bench::sink = frame.sumL;
+  });
+
+  paisa::MultitapEngine::CrossfadeStats stats = engine.getCrossfadeStats();
+  if (stats.frames > 0) {
+    std::string extra = std::string(name) + "/extra";
+    bench::report(extra.c_str(), sampleRate,
+                  (double)stats.nanoseconds / (double)stats.frames);
+  }
+}
+
+// Lets the enclosing scope compute with denormals, like a host thread that
+// never set the floating point mode
+class KeepDenormals {
+#if defined(__SSE__)
+  unsigned int saved = _mm_getcsr();
+
+public:
+  KeepDenormals() { _mm_setcsr(saved & ~0x8040u); }
+  ~KeepDenormals() { _mm_setcsr(saved); }
+#endif
+};
+
+// Every feedback path in the chain, fed noise, then left to ring out. The
+// /silent lines measure the tail once it is far below -300 dB: under the
+// guard Multitap_delay::process() puts around the engine, and with /noftz on
+// a thread that keeps denormals, where only the state flushing is left.
+// All of them should cost what /active does.
+static void runTail(const char *name, float sampleRate, int reverbMode,
+                    bool silent, bool guard) {
+  // The pre-roll is long, so skip it along with the measurement
+  if (bench::filter && !std::strstr(name, bench::filter))
+    return;
+  KeepDenormals keep;
+  paisa::MultitapEngine engine(reverbMode, sampleRate);
+  // Asleep, the tail would cost nothing at all
+  engine.setSleepEnabled(false);
+  paisa::MultitapEngine::Params params;
+  for (int t = 0; t < paisa::MultitapEngine::NUM_TAPS; t++) {
+    params.taps[t][0][1] = 0.8f;  // Feedback
+    params.taps[t][3][1] = 0.75f; // Shifter wet
+    params.taps[t][4][1] = 0.8f;  // Phaser depth
+  }
+  params.reverbMix = 0.5f;
+  params.reverbTime = 1.f;
+  engine.publish(params);
+  engine.reserve(sampleRate, engine.getLineMode());
+
+  paisa::MultitapEngine::Frame frame;
+  auto step = [&](float in) {
+    if (guard) {
+      paisa::ScopedFlushDenormals flush;
+      engine.process(in, in, sampleRate, frame);
+    } else {
+      engine.process(in, in, sampleRate, frame);
+    }
+    bench::sink = frame.sumL;
+  };
+  std::srand(1);
+  auto noise = [&]() { return (float)std::rand() / RAND_MAX - 0.5f; };
+
+  for (int i = 0; i < (int)sampleRate; i++)
+    step(noise());
+  if (silent) {
+    // Long enough for every loop to decay past the flush threshold
+    for (int i = 0; i < (int)(sampleRate * 60.f); i++)
+      step(0.f);
+  }
+  bench::run(name, sampleRate, 1, [&]() { step(silent ? 0.f : noise()); });
+}
+
+// Silent input once the tails are gone: the engine sleeps, and only checks
+// each input frame for signal. Compare with process/*.
+static void runIdle(const char *name, float sampleRate, int channels) {
+  paisa::MultitapEngine engine;
+  engine.setChannels(channels);
+  engine.publish(paisa::MultitapEngine::Params());
+  engine.reserve(sampleRate, engine.getLineMode());
+
+  float in[paisa::MultitapEngine::MAX_CHANNELS] = {0.5f};
+  paisa::MultitapEngine::Frame frame;
+  engine.process(in, in, sampleRate, frame);
+  std::fill(in, in + paisa::MultitapEngine::MAX_CHANNELS, 0.f);
+  while (!engine.isSleeping())
+    engine.process(in, in, sampleRate, frame);
+  bench::run(name, sampleRate, 1, [&]() {
+    engine.process(in, in, sampleRate, frame);
+    bench::sink = frame.sumL;
+  });
+}
+
+static void runTails(const char *reverb, int reverbMode) {
+  const float sampleRate = 48000.f;
+  std::string prefix = std::string("tail/") + reverb;
+  runTail((prefix + "/active").c_str(), sampleRate, reverbMode, false, true);
+  runTail((prefix + "/silent").c_str(), sampleRate, reverbMode, true, true);
+  runTail((prefix + "/silent/noftz").c_str(), sampleRate, reverbMode, true,
+          false);
+}
+
+void bench::engineSuite() {
+  for (float sampleRate : {44100.f, 48000.f, 96000.f, 192000.f}) {
+    runEngine("process/mono", sampleRate, 1);
+    runEngine("process/poly4", sampleRate, 4);
+    runEngine("process/poly16", sampleRate, 16);
+    runIdle("idle/mono", sampleRate, 1);
+    runIdle("idle/poly16", sampleRate, 16);
+    runCrossfade("crossfade/fdn", sampleRate,
+                 paisa::MultitapEngine::REVERB_FDN);
+    runCrossfade("crossfade/hole", sampleRate,
+                 paisa::MultitapEngine::REVERB_HOLE);
+  }
+  runTails("default", paisa::MultitapEngine::REVERB_DEFAULT);
+  runTails("fdn", paisa::MultitapEngine::REVERB_FDN);
+  runTails("hole", paisa::MultitapEngine::REVERB_HOLE);
+}
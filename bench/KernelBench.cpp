@@ -0,0 +1,278 @@
+#include "AmpPanProcessor.hpp"
+#include "Bench.hpp"
+#include "FDNReverb.hpp"
+#include "FilterProcessor.hpp"
+#include "FrequencyShifter.hpp"
+#include "HoleReverbWrapper.hpp"
+#include "LegacyHilbert.hpp"
+#include "Phaser.hpp"
+#include "Reverb.hpp"
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <memory>
+
+// One stereo instance of every stage in the tap chain, and each reverb, fed
+// with noise at module voltages, per frame.
+
+static const int BLOCK = 32;
+static const int NOISE_FRAMES = 4096;
+
+typedef paisa::float_4 float_4;
+
+namespace {
+
+struct Noise {
+  float left[NOISE_FRAMES], right[NOISE_FRAMES];
+  int position = 0;
+
+  Noise() {
+    srand(1);
+    for (int i = 0; i < NOISE_FRAMES; i++) {
+      left[i] = 5.f * (2.f * rand() / (float)RAND_MAX - 1.f);
+      right[i] = 5.f * (2.f * rand() / (float)RAND_MAX - 1.f);
+    }
+  }
+
+  // Copies the next block into l/r
+  void fill(float *l, float *r) {
+    std::copy(left + position, left + position + BLOCK, l);
+    std::copy(right + position, right + position + BLOCK, r);
+    position = (position + BLOCK) % NOISE_FRAMES;
+  }
+};
+
+template <typename P>
+void runBlock(const char *name, float sampleRate, Noise &noise, P &stage) {
+  float l[BLOCK], r[BLOCK];
+  bench::run(name, sampleRate, BLOCK, [&]() {
+    noise.fill(l, r);
+    stage.processBlock(l, r, BLOCK, sampleRate);
+    bench::sink = l[0] + r[BLOCK - 1];
+  });
+}
+
+template <typename R>
+void runFrames(const char *name, float sampleRate, Noise &noise, R &stage) {
+  float l[BLOCK], r[BLOCK];
+  bench::run(name, sampleRate, BLOCK, [&]() {
+    noise.fill(l, r);
+    for (int i = 0; i < BLOCK; i++)
+      stage.process(l[i], r[i], sampleRate);
+    bench::sink = l[0] + r[BLOCK - 1];
+  });
+}
+
+static float lane0(float x) { return x; }
+static float lane0(float_4 x) { return x[0]; }
+
+// The soft clipper as it was, on std::tanh(), and on exp() for float_4
+static float referenceSoftClip(float x) {
+  const float limit = 0.95f;
+  if (x > limit)
+    x = limit + (1.0f - limit) * std::tanh((x - limit) / (1.0f - limit));
+  else if (x < -limit)
+    x = -limit - (1.0f - limit) * std::tanh((-x - limit) / (1.0f - limit));
+  return x;
+}
+static float_4 referenceSoftClip(float_4 x) {
+  const float limit = 0.95f;
+  float_4 a = rack::simd::fabs(x);
+  float_4 u = 2.0f * (a - limit) / (1.0f - limit);
+  float_4 knee =
+      limit + (1.0f - limit) * (1.0f - 2.0f / (rack::simd::exp(u) + 1.0f));
+  knee = rack::simd::ifelse(x < 0.0f, -knee, knee);
+  return rack::simd::ifelse(a > limit, knee, x);
+}
+
+// A block of noise through `clip`, one frame per sample
+template <typename T, typename F>
+void runClip(const char *name, Noise &noise, F clip) {
+  float l[BLOCK], r[BLOCK];
+  bench::run(name, 48000.f, BLOCK, [&]() {
+    noise.fill(l, r);
+    T sum = 0.f;
+    for (int i = 0; i < BLOCK; i++)
+      sum += clip(T(l[i]));
+    bench::sink = lane0(sum);
+  });
+}
+
+// Largest difference between paisa::softClip() and the reference, from -10
+// to 10 V
+void reportClipError(const char *name) {
+  if (bench::filter && !std::strstr(name, bench::filter))
+    return;
+  double worst = 0.0;
+  for (int i = -200000; i <= 200000; i++) {
+    float x = (float)i * 5e-5f;
+    worst = std::max(worst, (double)std::fabs(paisa::softClip(x) -
+                                              referenceSoftClip(x)));
+    float_4 y = paisa::softClip(float_4(x)) - referenceSoftClip(float_4(x));
+    worst = std::max(worst, (double)std::fabs(y[0]));
+  }
+  bench::reportValue(name, 48000.f, "maxError", worst);
+}
+
+// One channel through a Hilbert pair, `pair(x, re, im)`, per sample
+template <typename T, typename F>
+void runHilbert(const char *name, float sampleRate, Noise &noise, F pair) {
+  float l[BLOCK], r[BLOCK];
+  bench::run(name, sampleRate, BLOCK, [&]() {
+    noise.fill(l, r);
+    T sum = 0.f;
+    for (int i = 0; i < BLOCK; i++) {
+      T re, im;
+      pair(T(l[i]), re, im);
+      sum += re + im;
+    }
+    bench::sink = lane0(sum);
+  });
+}
+
+// Worst image rejection of a TQuadrature mode, in dB, over sines a third of
+// an octave apart from `lowHz` to 20 kHz: how far the negative frequency of
+// re + j im sits under the positive one, measured over one Hann-windowed
+// second after a second to settle
+void reportImageRejection(const char *name, float sampleRate, int mode,
+                          float lowHz) {
+  if (bench::filter && !std::strstr(name, bench::filter))
+    return;
+  typedef std::complex<double> complex;
+  const int frames = (int)sampleRate;
+  double highHz = std::min(20000.0, 0.45 * sampleRate);
+  double worst = -INFINITY;
+  for (double f = lowHz; f <= highHz; f *= std::pow(2.0, 1.0 / 3.0)) {
+    paisa::TQuadrature<float> quadrature;
+    quadrature.setMode(mode);
+    double w = 2.0 * M_PI * f / sampleRate;
+    complex positive = 0.0, negative = 0.0;
+    for (int n = 0; n < 2 * frames; n++) {
+      float re, im;
+      quadrature.process((float)std::cos(w * n), re, im);
+      if (n < frames)
+        continue;
+      double hann = 0.5 - 0.5 * std::cos(2.0 * M_PI * (n - frames) / frames);
+      complex z = hann * complex(re, im);
+      positive += z * std::polar(1.0, -w * n);
+      negative += z * std::polar(1.0, w * n);
+    }
+    double image = std::abs(negative) / std::abs(positive);
+    worst = std::max(worst, 20.0 * std::log10(image));
+  }
+  bench::reportValue(name, sampleRate, "imageRejectionDb", worst);
+}
+
+} // namespace
+
+void bench::kernelSuite() {
+  Noise noise;
+  {
+    // The transformers alone, which don't depend on the sample rate: one
+    // stereo shifter runs two, a TapBank two on float_4
+    const float sampleRate = 48000.f;
+    typedef paisa::TQuadrature<float> Quadrature;
+    typedef paisa::TQuadrature<float_4> Quadrature4;
+    bench::LegacyHilbert<float> legacy;
+    paisa::TMatchingDelay<float> delay;
+    runHilbert<float>("hilbert/fir/legacy", sampleRate, noise,
+                      [&](float x, float &re, float &im) {
+                        re = delay.process(x);
+                        im = legacy.process(x);
+                      });
+    Quadrature fir, iir;
+    iir.setMode(Quadrature::HILBERT_IIR);
+    runHilbert<float>("hilbert/fir", sampleRate, noise,
+                      [&](float x, float &re, float &im) {
+                        fir.process(x, re, im);
+                      });
+    runHilbert<float>("hilbert/iir", sampleRate, noise,
+                      [&](float x, float &re, float &im) {
+                        iir.process(x, re, im);
+                      });
+    bench::LegacyHilbert<float_4> legacy4;
+    paisa::TMatchingDelay<float_4> delay4;
+    runHilbert<float_4>("hilbert/fir/legacy/float_4", sampleRate, noise,
+                        [&](float_4 x, float_4 &re, float_4 &im) {
+                          re = delay4.process(x);
+                          im = legacy4.process(x);
+                        });
+    Quadrature4 fir4, iir4;
+    iir4.setMode(Quadrature4::HILBERT_IIR);
+    runHilbert<float_4>("hilbert/fir/float_4", sampleRate, noise,
+                        [&](float_4 x, float_4 &re, float_4 &im) {
+                          fir4.process(x, re, im);
+                        });
+    runHilbert<float_4>("hilbert/iir/float_4", sampleRate, noise,
+                        [&](float_4 x, float_4 &re, float_4 &im) {
+                          iir4.process(x, re, im);
+                        });
+  }
+  {
+    // The output clipper of every shifter and phaser, on noise at module
+    // voltages, which mostly sits in the knee
+    runClip<float>("softclip/reference", noise,
+                   [](float x) { return referenceSoftClip(x); });
+    runClip<float>("softclip", noise,
+                   [](float x) { return paisa::softClip(x); });
+    runClip<float_4>("softclip/reference/float_4", noise,
+                     [](float_4 x) { return referenceSoftClip(x); });
+    runClip<float_4>("softclip/float_4", noise,
+                     [](float_4 x) { return paisa::softClip(x); });
+    reportClipError("softclip/accuracy");
+  }
+  for (float sampleRate : {44100.f, 48000.f, 96000.f, 192000.f}) {
+    {
+      paisa::FilterProcessor filter;
+      filter.setParams(0.3f, 0.6f);
+      runBlock("stage/filter", sampleRate, noise, filter);
+    }
+    {
+      paisa::AmpPanProcessor amppan;
+      amppan.setParams(0.8f, 0.3f);
+      runBlock("stage/amppan", sampleRate, noise, amppan);
+    }
+    {
+      std::unique_ptr<paisa::FrequencyShifter> shifter(
+          new paisa::FrequencyShifter());
+      shifter->setParams(0.4f, 0.8f);
+      runBlock("stage/shifter", sampleRate, noise, *shifter);
+      shifter->setHilbert(paisa::TQuadrature<float>::HILBERT_IIR);
+      runBlock("stage/shifter/iir", sampleRate, noise, *shifter);
+      shifter->setStereo(paisa::FrequencyShifter::STEREO_SPREAD);
+      runBlock("stage/shifter/iir/spread", sampleRate, noise, *shifter);
+    }
+    {
+      typedef paisa::TQuadrature<float> Quadrature;
+      reportImageRejection("hilbert/fir/accuracy", sampleRate,
+                           Quadrature::HILBERT_FIR, 20.f);
+      reportImageRejection("hilbert/fir/accuracy/above-1khz", sampleRate,
+                           Quadrature::HILBERT_FIR, 1000.f);
+      reportImageRejection("hilbert/iir/accuracy", sampleRate,
+                           Quadrature::HILBERT_IIR, 20.f);
+      reportImageRejection("hilbert/iir/accuracy/above-1khz", sampleRate,
+                           Quadrature::HILBERT_IIR, 1000.f);
+    }
+    {
+      paisa::Phaser phaser;
+      phaser.setParams(0.5f, 0.7f, 0.2f);
+      runBlock("stage/phaser", sampleRate, noise, phaser);
+    }
+    {
+      std::unique_ptr<paisa::Reverb> reverb(new paisa::Reverb());
+      reverb->setParams(0.3f, 0.5f, 0.5f, 0.2f, 1.f, 1.f, 1.25f);
+      runFrames("reverb/default", sampleRate, noise, *reverb);
+    }
+    {
+      std::unique_ptr<paisa::FDNReverb> reverb(new paisa::FDNReverb());
+      reverb->setParams(0.3f, 0.5f, 0.5f);
+      runFrames("reverb/fdn", sampleRate, noise, *reverb);
+    }
+    {
+      std::unique_ptr<paisa::HoleReverb> reverb(new paisa::HoleReverb());
+      reverb->setParams(0.3f, 0.5f, 0.5f);
+      runFrames("reverb/hole", sampleRate, noise, *reverb);
+      runBlock("reverb/hole-block", sampleRate, noise, *reverb);
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846f
+#endif
+
+namespace bench {
+
+/**
+ * The FIR Hilbert transformer as it was before the polyphase rewrite: all
+ * 127 taps, half of them zero, over a ring buffer with a wrap per tap. Kept
+ * as the baseline.
+ */
+template <typename T> class LegacyHilbert {
+  static constexpr int TAPS = 127;
+  static constexpr int M = 63;
+  float kernel[TAPS];
+  T buffer[TAPS];
+  int writeIdx = 0;
+
+public:
+  LegacyHilbert() {
+    std::fill(buffer, buffer + TAPS, T(0.0f));
+    for (int n = 0; n < TAPS; n++) {
+      int k = n - M;
+      if (k == 0 || (k % 2 == 0)) {
+        kernel[n] = 0.0f;
+      } else {
+        const float a0 = 0.355768f;
+        const float a1 = 0.487396f;
+        const float a2 = 0.144232f;
+        const float a3 = 0.012604f;
+
+        float window = a0 - a1 * std::cos(2.0f * M_PI * n / (TAPS - 1)) +
+                       a2 * std::cos(4.0f * M_PI * n / (TAPS - 1)) -
+                       a3 * std::cos(6.0f * M_PI * n / (TAPS - 1));
+        kernel[n] = window * (2.0f / (M_PI * (float)k));
+      }
+    }
+  }
+
+  T process(T x) {
+    buffer[writeIdx] = x;
+    T sum = 0.0f;
+    for (int i = 0; i < TAPS; i++) {
+      int readIdx = writeIdx - i;
+      if (readIdx < 0)
+        readIdx += TAPS;
+      sum += buffer[readIdx] * kernel[i];
+    }
+    writeIdx = (writeIdx + 1) % TAPS;
+    return sum;
+  }
+};
+
+} // namespace bench
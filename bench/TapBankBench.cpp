@@ -0,0 +1,109 @@
+#include "Bench.hpp"
+#include "TapBank.hpp"
+#include "Tap.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// All four taps of one voice with every stage of the chain running, per
+// frame: the object per tap layout against the bank with the taps in lanes.
+// The /delay-pan lines leave the filter, shifter and phaser neutral, so they
+// drop out of the chain, and only the delay and amp/pan are paid for. The
+// /phaser lines add the phaser back on its own. The /short lines run the
+// full chain with tap 1 at the shortest delay, 1 ms, which sets the
+// sub-block of the bank's lanes and is shorter than the shifter's latency.
+
+static const int NUM_TAPS = 4;
+static const int BLOCK = 32;
+static const size_t MAX_DELAY_SAMPLES = 192000 * 10;
+
+enum Chain { CHAIN_ALL, CHAIN_DELAY_PAN, CHAIN_PHASER, CHAIN_SHORT_TAP };
+
+template <typename F> static void configure(F setParam, int chain) {
+  for (int t = 0; t < NUM_TAPS; t++) {
+    float time = chain == CHAIN_SHORT_TAP && t == 0 ? 0.f : 0.35f + 0.1f * t;
+    setParam(t, 0, time, 0.5f);       // Delay, feedback
+    setParam(t, 1, 0.85f, 0.25f * t); // Amp, pan
+    if (chain == CHAIN_DELAY_PAN || chain == CHAIN_PHASER) {
+      setParam(t, 2, 0.f, 1.f);  // Filter over the full range
+      setParam(t, 3, 0.4f, 0.5f); // Shifter wet in the detent
+    } else {
+      setParam(t, 2, 0.3f, 0.6f); // Filter
+      setParam(t, 3, 0.4f, 0.8f); // Shifter
+    }
+    if (chain == CHAIN_DELAY_PAN)
+      setParam(t, 4, 0.5f, 0.f); // Phaser at zero depth
+    else
+      setParam(t, 4, 0.5f, 0.7f); // Phaser
+  }
+}
+
+void bench::tapBankSuite() {
+  for (float sampleRate : {44100.f, 48000.f, 96000.f, 192000.f}) {
+    for (int chain :
+         {CHAIN_ALL, CHAIN_DELAY_PAN, CHAIN_PHASER, CHAIN_SHORT_TAP}) {
+      float in[BLOCK];
+      int n = 0;
+      auto fill = [&]() {
+        for (int i = 0; i < BLOCK; i++)
+          in[i] = (n++ & 4095) < 64 ? 0.5f : 0.f;
+      };
+      // Long enough for the neutral stages to fade out of the chain
+      int settle = (int)sampleRate / BLOCK;
+      std::string suffix;
+      if (chain == CHAIN_DELAY_PAN)
+        suffix = "/delay-pan";
+      else if (chain == CHAIN_PHASER)
+        suffix = "/phaser";
+      else if (chain == CHAIN_SHORT_TAP)
+        suffix = "/short";
+
+      {
+        std::vector<std::unique_ptr<paisa::Tap>> taps;
+        for (int t = 0; t < NUM_TAPS; t++)
+          taps.push_back(std::unique_ptr<paisa::Tap>(
+              new paisa::Tap(MAX_DELAY_SAMPLES)));
+        configure(
+            [&](int t, int mode, float p1, float p2) {
+              taps[t]->setParam(mode, p1, p2);
+            },
+            chain);
+        for (auto &tap : taps)
+          tap->reserve(sampleRate);
+
+        float outL[NUM_TAPS][BLOCK], outR[NUM_TAPS][BLOCK];
+        auto process = [&]() {
+          fill();
+          for (int t = 0; t < NUM_TAPS; t++)
+            taps[t]->processBlock(in, in, outL[t], outR[t], BLOCK,
+                                  sampleRate);
+          sink = outL[0][0] + outR[3][BLOCK - 1];
+        };
+        for (int i = 0; i < settle; i++)
+          process();
+        run(("taps/vector" + suffix).c_str(), sampleRate, BLOCK, process);
+      }
+
+      {
+        std::unique_ptr<paisa::TapBank> bank(
+            new paisa::TapBank(MAX_DELAY_SAMPLES));
+        configure(
+            [&](int t, int mode, float p1, float p2) {
+              bank->setParam(t, mode, p1, p2);
+            },
+            chain);
+        bank->reserve(sampleRate);
+
+        paisa::float_4 outL[BLOCK], outR[BLOCK];
+        auto process = [&]() {
+          fill();
+          bank->processBlock(in, in, outL, outR, BLOCK, sampleRate);
+          sink = outL[0][0] + outR[BLOCK - 1][3];
+        };
+        for (int i = 0; i < settle; i++)
+          process();
+        run(("taps/bank" + suffix).c_str(), sampleRate, BLOCK, process);
+      }
+    }
+  }
+}
@@ -0,0 +1,19 @@
+#include "Bench.hpp"
+#include "Denormals.hpp"
+
+volatile float bench::sink = 0.f;
+const char *bench::filter = nullptr;
+
+// Usage: bench [name filter]
+int main(int argc, char **argv) {
+  if (argc > 1)
+    bench::filter = argv[1];
+  // Measured under the same floating point mode as the Rack engine
+  paisa::flushDenormals();
+
+  bench::delaySuite();
+  bench::kernelSuite();
+  bench::tapBankSuite();
+  bench::engineSuite();
+  return 0;
+}
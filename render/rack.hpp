@@ -0,0 +1,168 @@
+#pragma once
+// Just enough of the Rack SDK for the DSP sources to build without it: the
+// float_4 vector and math helpers they use, and the Module declarations
+// that plugin.hpp and Multitap_delay.hpp refer to. Nothing here is ever run
+// as a module.
+// float_4 arithmetic uses compiler vector extensions, while exp() and the
+// trigonometric functions run one lane at a time through <cmath>. Results
+// can differ from the plugin in the last bits where Rack approximates.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct json_t;
+
+namespace rack {
+
+namespace math {
+inline float clamp(float x, float a = 0.f, float b = 1.f) {
+  return std::fmax(std::fmin(x, b), a);
+}
+inline int clamp(int x, int a, int b) { return std::max(std::min(x, b), a); }
+} // namespace math
+
+namespace simd {
+
+template <typename T, int N> struct Vector;
+
+// GCC and Clang vector extensions, so the lanes compile to SSE or NEON
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int32_t v4si __attribute__((vector_size(16)));
+
+template <> struct Vector<float, 4> {
+  typedef float type;
+  static constexpr int size = 4;
+  union {
+    v4sf v;
+    float s[4];
+  };
+
+  Vector() = default;
+  Vector(v4sf v) : v(v) {}
+  Vector(float x) : v(v4sf{x, x, x, x}) {}
+  Vector(float a, float b, float c, float d) : v(v4sf{a, b, c, d}) {}
+  static Vector zero() { return Vector(0.f); }
+  static Vector load(const float *x) { return Vector(x[0], x[1], x[2], x[3]); }
+  void store(float *x) const { std::copy(s, s + 4, x); }
+  float &operator[](int i) { return s[i]; }
+  const float &operator[](int i) const { return s[i]; }
+};
+
+typedef Vector<float, 4> float_4;
+
+#define PAISA_STUB_OP(op)                                                      \
+  inline float_4 operator op(const float_4 &a, const float_4 &b) {           \
+    return float_4(a.v op b.v);                                                \
+  }                                                                            \
+  inline float_4 &operator op##=(float_4 &a, const float_4 &b) {             \
+    return a = a op b;                                                         \
+  }
+PAISA_STUB_OP(+)
+PAISA_STUB_OP(-)
+PAISA_STUB_OP(*)
+PAISA_STUB_OP(/)
+#undef PAISA_STUB_OP
+
+// Comparisons return all-ones or all-zero lanes, like the SSE versions
+#define PAISA_STUB_CMP(op)                                                     \
+  inline float_4 operator op(const float_4 &a, const float_4 &b) {           \
+    return float_4((v4sf)(a.v op b.v));                                        \
+  }
+PAISA_STUB_CMP(==)
+PAISA_STUB_CMP(!=)
+PAISA_STUB_CMP(<)
+PAISA_STUB_CMP(>)
+PAISA_STUB_CMP(<=)
+PAISA_STUB_CMP(>=)
+#undef PAISA_STUB_CMP
+
+inline float_4 operator-(const float_4 &a) { return 0.f - a; }
+inline float_4 operator+(const float_4 &a) { return a; }
+
+using std::cos;
+using std::exp;
+using std::fabs;
+using std::floor;
+using std::fmax;
+using std::fmin;
+using std::log;
+using std::sin;
+using std::sqrt;
+
+#define PAISA_STUB_FN(fn)                                                      \
+  inline float_4 fn(float_4 a) {                                               \
+    return float_4(std::fn(a.s[0]), std::fn(a.s[1]), std::fn(a.s[2]),          \
+                   std::fn(a.s[3]));                                           \
+  }
+PAISA_STUB_FN(sin)
+PAISA_STUB_FN(cos)
+PAISA_STUB_FN(exp)
+PAISA_STUB_FN(log)
+PAISA_STUB_FN(sqrt)
+PAISA_STUB_FN(floor)
+#undef PAISA_STUB_FN
+
+inline float_4 fabs(float_4 a) {
+  return float_4((v4sf)((v4si)a.v & (v4si){0x7fffffff, 0x7fffffff, 0x7fffffff,
+                                           0x7fffffff}));
+}
+inline float_4 ifelse(float_4 m, float_4 a, float_4 b) {
+  v4si mask = (v4si)m.v;
+  return float_4((v4sf)((mask & (v4si)a.v) | (~mask & (v4si)b.v)));
+}
+inline float_4 fmax(float_4 a, float_4 b) { return ifelse(a > b, a, b); }
+inline float_4 fmin(float_4 a, float_4 b) { return ifelse(a < b, a, b); }
+inline float_4 clamp(float_4 x, float_4 a = 0.f, float_4 b = 1.f) {
+  return fmin(fmax(x, a), b);
+}
+inline float ifelse(bool cond, float a, float b) { return cond ? a : b; }
+
+} // namespace simd
+
+namespace engine {
+
+struct Port {
+  enum Type { INPUT, OUTPUT };
+};
+
+struct Module {
+  struct ProcessArgs {
+    float sampleRate;
+    float sampleTime;
+    int64_t frame;
+  };
+  struct SampleRateChangeEvent {
+    float sampleRate;
+    float sampleTime;
+  };
+  struct PortChangeEvent {
+    bool connecting;
+    Port::Type type;
+    int portId;
+  };
+
+  virtual ~Module() {}
+  virtual void process(const ProcessArgs &args) {}
+  virtual void onSampleRateChange(const SampleRateChangeEvent &e) {}
+  virtual void onPortChange(const PortChangeEvent &e) {}
+  virtual json_t *dataToJson() { return nullptr; }
+  virtual void dataFromJson(json_t *rootJ) {}
+};
+
+} // namespace engine
+
+using engine::Module;
+
+struct Plugin;
+struct Model;
+namespace ui {
+struct MenuItem;
+}
+using ui::MenuItem;
+
+#define ENUMS(name, count) name, name##_LAST = name + (count)-1
+
+} // namespace rack
@@ -0,0 +1,250 @@
+#include "Denormals.hpp"
+#include "MultitapEngine.hpp"
+#include "Multitap_delay.hpp"
+#include "dr_wav.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Offline renderer: runs a WAV file through the Multitap DSP (the tap chain
+// and the selected reverb) as fast as the machine allows, and writes the
+// SUM output, or one tap output, as a 32-bit float WAV.
+
+static const char *MODE_NAMES[Multitap_delay::NUM_MODES] = {
+    "delay", "amppan", "filter", "shifter", "phaser"};
+
+static void usage() {
+  std::fprintf(
+      stderr,
+      "usage: render [options] input.wav output.wav\n"
+      "  -r, --rate HZ          run the DSP at HZ instead of the file's rate\n"
+      "                         (the samples are not resampled)\n"
+      "  -v, --reverb N         0 default, 1 FDN, 2 hole (default 0)\n"
+      "  -m, --mix X            reverb mix 0..1 (default 0.3)\n"
+      "  -G, --gravity X        reverb gravity 0..1 (default 0.5)\n"
+      "  -d, --diffusion X      reverb diffusion 0..1 (default 0.5)\n"
+      "  -p, --param T:MODE:A:B knob pair of tap T (1-4, or 0 for all)\n"
+      "                         in MODE: delay, amppan, filter, shifter,\n"
+      "                         phaser; may be repeated\n"
+      "  -n, --noise X          phaser noise gain 0..1 (default 0)\n"
+      "  -g, --gain DB          input gain in dB (default 0)\n"
+      "  -V, --volts V          volts at digital full scale (default 10, as\n"
+      "                         Rack's audio interface module)\n"
+      "  -b, --block N          engine block size, 1 for no latency (32)\n"
+      "  -s, --shared           taps as read heads on one shared line\n"
+      "  -i, --interp N         delay interpolation, 0 linear .. 4 sinc\n"
+      "  -H, --hilbert N        frequency shifter, 0 FIR, 1 IIR (default 0)\n"
+      "  -w, --spread           frequency shifter with the stereo spread\n"
+      "  -t, --tail SEC         extra seconds rendered after the input (2)\n"
+      "  -o, --tap N            write tap N (1-4) instead of the SUM output\n");
+}
+
+int main(int argc, char **argv) {
+  float rate = 0.f;
+  int reverbMode = 0;
+  float gainDb = 0.f;
+  float volts = 10.f;
+  int blockSize = 32;
+  int lineMode = paisa::MultitapEngine::INDEPENDENT_LINES;
+  int interpolation = paisa::DelayProcessor::INTERP_LINEAR;
+  int hilbert = paisa::TQuadrature<float>::HILBERT_FIR;
+  int shifterStereo = paisa::FrequencyShifter::STEREO_LINKED;
+  float tail = 2.f;
+  int outputTap = 0;
+
+  // Same defaults as a freshly added module
+  paisa::MultitapEngine::Params params;
+
+  static const option longOptions[] = {
+      {"rate", required_argument, nullptr, 'r'},
+      {"reverb", required_argument, nullptr, 'v'},
+      {"mix", required_argument, nullptr, 'm'},
+      {"gravity", required_argument, nullptr, 'G'},
+      {"diffusion", required_argument, nullptr, 'd'},
+      {"param", required_argument, nullptr, 'p'},
+      {"noise", required_argument, nullptr, 'n'},
+      {"gain", required_argument, nullptr, 'g'},
+      {"volts", required_argument, nullptr, 'V'},
+      {"block", required_argument, nullptr, 'b'},
+      {"shared", no_argument, nullptr, 's'},
+      {"interp", required_argument, nullptr, 'i'},
+      {"hilbert", required_argument, nullptr, 'H'},
+      {"spread", no_argument, nullptr, 'w'},
+      {"tail", required_argument, nullptr, 't'},
+      {"tap", required_argument, nullptr, 'o'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "r:v:m:G:d:p:n:g:V:b:si:H:wt:o:h",
+                          longOptions, nullptr)) != -1) {
+    switch (c) {
+    case 'r':
+      rate = std::atof(optarg);
+      break;
+    case 'v':
+      reverbMode = rack::math::clamp(std::atoi(optarg), 0, 2);
+      break;
+    case 'm':
+      params.reverbMix = std::atof(optarg);
+      break;
+    case 'G':
+      params.reverbGravity = std::atof(optarg);
+      break;
+    case 'd':
+      params.reverbDiffusion = std::atof(optarg);
+      break;
+    case 'p': {
+      int tap;
+      char mode[16];
+      float a, b;
+      if (std::sscanf(optarg, "%d:%15[a-z]:%f:%f", &tap, mode, &a, &b) != 4 ||
+          tap < 0 || tap > paisa::MultitapEngine::NUM_TAPS) {
+        std::fprintf(stderr, "render: bad --param '%s'\n", optarg);
+        return 1;
+      }
+      int m = 0;
+      while (m < Multitap_delay::NUM_MODES &&
+             std::strcmp(mode, MODE_NAMES[m]) != 0)
+        m++;
+      if (m == Multitap_delay::NUM_MODES) {
+        std::fprintf(stderr, "render: unknown mode '%s'\n", mode);
+        return 1;
+      }
+      for (int t = 0; t < paisa::MultitapEngine::NUM_TAPS; t++) {
+        if (tap == 0 || tap == t + 1) {
+          params.taps[t][m][0] = a;
+          params.taps[t][m][1] = b;
+        }
+      }
+      break;
+    }
+    case 'n':
+      params.phaserNoise = std::atof(optarg);
+      break;
+    case 'g':
+      gainDb = std::atof(optarg);
+      break;
+    case 'V':
+      volts = (float)std::atof(optarg);
+      if (volts <= 0.f) {
+        std::fprintf(stderr, "render: --volts must be positive\n");
+        return 1;
+      }
+      break;
+    case 'b':
+      blockSize = std::atoi(optarg);
+      break;
+    case 's':
+      lineMode = paisa::MultitapEngine::SHARED_LINE;
+      break;
+    case 'i':
+      interpolation = std::atoi(optarg);
+      break;
+    case 'H':
+      hilbert = std::atoi(optarg);
+      break;
+    case 'w':
+      shifterStereo = paisa::FrequencyShifter::STEREO_SPREAD;
+      break;
+    case 't':
+      tail = std::max(0.f, (float)std::atof(optarg));
+      break;
+    case 'o':
+      outputTap = rack::math::clamp(std::atoi(optarg), 0, 4);
+      break;
+    default:
+      usage();
+      return c == 'h' ? 0 : 1;
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    return 1;
+  }
+  const char *inPath = argv[optind];
+  const char *outPath = argv[optind + 1];
+
+  unsigned int channels, fileRate;
+  drwav_uint64 inFrames;
+  float *input = drwav_open_file_and_read_pcm_frames_f32(
+      inPath, &channels, &fileRate, &inFrames, nullptr);
+  if (!input) {
+    std::fprintf(stderr, "render: can't read '%s'\n", inPath);
+    return 1;
+  }
+  if (channels > 2) {
+    std::fprintf(stderr, "render: only mono and stereo input is supported\n");
+    drwav_free(input, nullptr);
+    return 1;
+  }
+  float sampleRate = rate > 0.f ? rate : (float)fileRate;
+
+  // Configured the same way Multitap_delay sets up its engine
+  std::unique_ptr<paisa::MultitapEngine> engine(
+      new paisa::MultitapEngine(reverbMode, sampleRate));
+  engine->setBlockSize(blockSize);
+  engine->setLineMode(lineMode);
+  engine->setInterpolation(interpolation);
+  engine->setHilbert(hilbert);
+  engine->setShifterStereo(shifterStereo);
+  engine->publish(params);
+  engine->reserve(sampleRate, lineMode);
+
+  // The block latency is skipped so the output lines up with the input
+  size_t latency = engine->getLatency();
+  size_t total = (size_t)inFrames + (size_t)(tail * sampleRate);
+  std::vector<float> output(2 * total);
+  // Samples become Rack voltages for the DSP and back for the file
+  float gain = std::pow(10.f, gainDb / 20.f) * volts;
+
+  paisa::flushDenormals();
+  paisa::MultitapEngine::Frame frame;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total + latency; i++) {
+    float l = 0.f, r = 0.f;
+    if (i < inFrames) {
+      l = input[i * channels] * gain;
+      r = input[i * channels + channels - 1] * gain;
+    }
+    engine->process(l, r, sampleRate, frame);
+    if (i < latency)
+      continue;
+    float *o = &output[2 * (i - latency)];
+    o[0] = (outputTap ? frame.tapL[outputTap - 1][0] : frame.sumL) / volts;
+    o[1] = (outputTap ? frame.tapR[outputTap - 1][0] : frame.sumR) / volts;
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  drwav_free(input, nullptr);
+
+  drwav_data_format format;
+  format.container = drwav_container_riff;
+  format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+  format.channels = 2;
+  format.sampleRate = (drwav_uint32)sampleRate;
+  format.bitsPerSample = 32;
+  drwav wav;
+  if (!drwav_init_file_write(&wav, outPath, &format, nullptr)) {
+    std::fprintf(stderr, "render: can't write '%s'\n", outPath);
+    return 1;
+  }
+  drwav_uint64 written = drwav_write_pcm_frames(&wav, total, output.data());
+  drwav_uninit(&wav);
+  if (written != total) {
+    std::fprintf(stderr, "render: short write to '%s'\n", outPath);
+    return 1;
+  }
+
+  std::fprintf(stderr,
+               "render: %zu frames at %g Hz in %.3f s (%.1fx real time)\n",
+               total, sampleRate, seconds,
+               (double)total / sampleRate / std::max(seconds, 1e-9));
+  return 0;
+}
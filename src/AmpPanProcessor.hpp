@@ -6,7 +6,7 @@
 
 namespace paisa {
 
-class AmpPanProcessor : public Processor {
+template <typename T> class TAmpPanProcessor : public TProcessor<T> {
   float normalizedAmp = 0.5f;
   float normalizedPan = 0.5f;
   Panner panner;
@@ -25,28 +25,45 @@ public:
     }
   }
 
-  void process(float &left, float &right, float sampleRate) override {
-    if (dirty) {
-      // Clip the implementation
-      float k1 = std::max(0.0f, std::min(1.0f, normalizedAmp));
-      float k2 = std::max(0.0f, std::min(1.0f, normalizedPan));
-
-      // Logarithmic curve for amplitude (linear in dB)
-      // Consistent with how volume is perceived
-      float gainDb = k1 * 78.f - 72.f; // -72dB to +6dB
-      gain = std::pow(10.f, gainDb / 20.f);
-
-      // Linear for panning (the Panner internally handles constant power law)
-      panValue = k2 * 2.f - 1.f; // Map [0, 1] to [-1, 1]
-
-      dirty = false;
-    }
+  void process(T &left, T &right, float sampleRate) override {
+    updateGain();
 
     left *= gain;
     right *= gain;
 
     panner.process(left, right, panValue);
   }
+
+  void processBlock(T *left, T *right, int frames,
+                    float sampleRate) override {
+    updateGain();
+    panner.processBlock(left, right, frames, panValue, gain);
+  }
+
+  // Knob positions to a linear gain and a pan position in [-1, 1]
+  static void mapParams(float p1, float p2, float &gain, float &pan) {
+    // Clip the implementation
+    float k1 = std::max(0.0f, std::min(1.0f, p1));
+    float k2 = std::max(0.0f, std::min(1.0f, p2));
+
+    // Logarithmic curve for amplitude (linear in dB)
+    // Consistent with how volume is perceived
+    float gainDb = k1 * 78.f - 72.f; // -72dB to +6dB
+    gain = std::pow(10.f, gainDb / 20.f);
+
+    // Linear for panning (the Panner internally handles constant power law)
+    pan = k2 * 2.f - 1.f; // Map [0, 1] to [-1, 1]
+  }
+
+private:
+  void updateGain() {
+    if (!dirty)
+      return;
+    mapParams(normalizedAmp, normalizedPan, gain, panValue);
+    dirty = false;
+  }
 };
 
+typedef TAmpPanProcessor<float> AmpPanProcessor;
+
 } // namespace paisa
@@ -0,0 +1,198 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace paisa {
+
+/**
+ * Stereo ring buffer made of fixed-size pages that are only allocated once
+ * the delay time in use needs them.
+ * The number of pages is always a power of two, so positions wrap with a
+ * mask. Growing is split in two: reserve() allocates the new pages on a
+ * non-audio thread, commit() links them into the ring on the audio thread.
+ * Linking reorders page pointers and splits the one page being written, so
+ * the history survives without copying the whole buffer.
+ * Any number of non-audio threads may call reserve(). A larger request
+ * replaces one still waiting for commit().
+ * Every page ends with GUARD frames mirroring the start of the next page, so
+ * an interpolator can read a short run of frames from a single page.
+ * T is float, or rack::simd::float_4 for four polyphonic voices per frame.
+ */
+template <typename T> class TDelayLine {
+public:
+  static constexpr int PAGE_BITS = 12;
+  static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS; // frames
+  static constexpr size_t GUARD = 8;                          // frames
+
+private:
+  struct Growth {
+    size_t numPages = 0;
+    // One page per slot added to the line as it was when they were
+    // allocated. It may have grown since, leaving some of them unused.
+    std::vector<std::unique_ptr<T[]>> pages;
+    Growth *next = nullptr;
+  };
+
+  // Page layout: PAGE_SIZE + GUARD interleaved frames, left then right
+  std::vector<T *> table;
+  std::vector<T *> scratch; // Old table while commit() reorders it
+  size_t pageMask = 0;
+  std::atomic<size_t> numPages{0};
+  size_t writePos = 0; // Absolute frame counter, never wrapped
+
+  // Set by reserve(), taken by commit()
+  std::atomic<Growth *> pending{nullptr};
+  Growth *committed = nullptr; // Keeps every linked page alive
+  // Serializes reserve() callers. The audio thread never takes it.
+  std::mutex reserveMutex;
+
+  static size_t nextPow2(size_t n) {
+    size_t p = 1;
+    while (p < n)
+      p <<= 1;
+    return p;
+  }
+
+  T *pageAt(size_t pos) const {
+    return table[(pos >> PAGE_BITS) & pageMask];
+  }
+
+public:
+  TDelayLine(size_t maxFrames) {
+    table.resize(nextPow2((maxFrames + PAGE_SIZE - 1) / PAGE_SIZE), nullptr);
+    scratch.resize(table.size(), nullptr);
+  }
+
+  ~TDelayLine() {
+    delete pending.load();
+    while (committed) {
+      Growth *next = committed->next;
+      delete committed;
+      committed = next;
+    }
+  }
+
+  TDelayLine(const TDelayLine &) = delete;
+  TDelayLine &operator=(const TDelayLine &) = delete;
+
+  size_t getCapacity() const { return numPages.load() * PAGE_SIZE; }
+
+  // Makes sure at least `frames` frames of history fit. Allocates, so it must
+  // not be called from the audio thread.
+  void reserve(size_t frames) {
+    std::lock_guard<std::mutex> lock(reserveMutex);
+    size_t wanted = nextPow2((frames + PAGE_SIZE - 1) / PAGE_SIZE);
+    wanted = std::min(wanted, table.size());
+    // Once commit() has taken a growth it keeps it alive, so `queued` can
+    // be read whether or not it is still pending
+    Growth *queued = pending.load(std::memory_order_acquire);
+    size_t current = numPages.load(std::memory_order_acquire);
+    if (wanted <= std::max(current, queued ? queued->numPages : 0))
+      return;
+
+    Growth *growth = new Growth();
+    growth->numPages = wanted;
+    for (size_t i = current; i < wanted; i++)
+      growth->pages.emplace_back(new T[2 * (PAGE_SIZE + GUARD)]());
+    if (pending.compare_exchange_strong(queued, growth,
+                                        std::memory_order_acq_rel)) {
+      // Replaced before the audio thread got to it
+      delete queued;
+    } else {
+      // commit() took the queued growth in the meantime. Only reserve()
+      // fills the slot, so it is empty now.
+      pending.store(growth, std::memory_order_release);
+    }
+  }
+
+  // Links pages prepared by reserve() into the ring. Audio thread only.
+  void commit() {
+    Growth *growth = pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (!growth)
+      return;
+    growth->next = committed;
+    committed = growth;
+
+    size_t n = numPages.load(std::memory_order_relaxed);
+    size_t m = growth->numPages;
+    // Queued while an earlier commit() was linking a bigger one, which
+    // reserve() can't tell from an empty slot
+    if (m <= n)
+      return;
+    std::vector<T *> &t = table;
+    size_t fresh = 0;
+
+    if (n == 0) {
+      for (size_t j = 0; j < m; j++)
+        t[j] = growth->pages[fresh++].get();
+    } else {
+      // Each old slot j holds the most recent page number q with q % n == j.
+      // In the bigger ring that page belongs to slot q % m, and every slot
+      // left over gets a fresh page.
+      size_t qw = writePos >> PAGE_BITS;
+      std::vector<T *> &old = scratch;
+      for (size_t j = 0; j < n; j++)
+        old[j] = t[j];
+      for (size_t j = 0; j < m; j++)
+        t[j] = nullptr;
+      for (size_t j = 0; j < n; j++) {
+        size_t q = qw - ((qw - j) & (n - 1));
+        t[q & (m - 1)] = old[j];
+      }
+      for (size_t j = 0; j < m; j++) {
+        if (!t[j])
+          t[j] = growth->pages[fresh++].get();
+      }
+      // The page being written still holds the tail of the page one lap
+      // older, which now lives in its own slot.
+      size_t offset = writePos & (PAGE_SIZE - 1);
+      T *src = t[qw & (m - 1)];
+      T *dst = t[(qw - n) & (m - 1)];
+      std::copy(src + 2 * offset, src + 2 * PAGE_SIZE, dst + 2 * offset);
+    }
+
+    // Neighbours changed, so every guard has to be refreshed
+    for (size_t j = 0; j < m; j++) {
+      const T *next = t[(j + 1) & (m - 1)];
+      std::copy(next, next + 2 * GUARD, t[j] + 2 * PAGE_SIZE);
+    }
+
+    pageMask = m - 1;
+    numPages.store(m, std::memory_order_release);
+  }
+
+  bool isAllocated() const { return table[0] != nullptr; }
+
+  // Interleaved frames starting `age` frames behind the frame `offset` frames
+  // after the write position, oldest first. GUARD + 1 frames can be read from
+  // the returned pointer. The line must be allocated.
+  const T *frames(size_t offset, size_t age) const {
+    size_t p = writePos + offset - age;
+    return pageAt(p) + 2 * (p & (PAGE_SIZE - 1));
+  }
+
+  void write(T left, T right) {
+    size_t slot = (writePos >> PAGE_BITS) & pageMask;
+    T *page = table[slot];
+    if (page) {
+      size_t o = writePos & (PAGE_SIZE - 1);
+      page[2 * o] = left;
+      page[2 * o + 1] = right;
+      if (o < GUARD) {
+        T *prev = table[(slot - 1) & pageMask] + 2 * PAGE_SIZE;
+        prev[2 * o] = left;
+        prev[2 * o + 1] = right;
+      }
+    }
+    writePos++;
+  }
+};
+
+typedef TDelayLine<float> DelayLine;
+
+} // namespace paisa
@@ -1,45 +1,255 @@
 #pragma once
+#include "DelayLine.hpp"
+#include "Interpolation.hpp"
 #include "Processor.hpp"
 #include <algorithm>
 #include <cmath>
-#include <vector>
 
 namespace paisa {
 
-class DelayProcessor {
-  std::vector<float> bufferL;
-  std::vector<float> bufferR;
-  size_t writeIndex = 0;
+/**
+ * Delay with feedback amount, fractional read kernels and delay time glide.
+ * T is float, or rack::simd::float_4 to run four polyphonic voices that
+ * share the same settings.
+ */
+template <typename T> class TDelayProcessor {
+public:
+  enum Interpolation {
+    INTERP_LINEAR,
+    INTERP_LAGRANGE3,
+    INTERP_HERMITE,
+    INTERP_ALLPASS,
+    INTERP_SINC,
+    NUM_INTERPOLATIONS
+  };
+
+  // How the read head gets to a new delay time
+  enum Glide {
+    // The head slides there, bending the pitch like a tape delay
+    GLIDE_TAPE,
+    // A second head starts at the new time and the two are crossfaded
+    GLIDE_CROSSFADE,
+    NUM_GLIDES
+  };
+
+  // Latency compensation stops short of this many frames, one control block
+  // of the shifter and the phaser
+  static constexpr int MIN_COMPENSATED_FRAMES = 16;
+
+private:
+  typedef void (TDelayProcessor::*Reader)(const TDelayLine<T> &, T *, T *,
+                                          int, float, float,
+                                          TInterpolationState<T> &);
+
+  TDelayLine<T> line;
+
+  // Kernel picked by setInterpolation()
+  int interpolation = INTERP_LINEAR;
+  Reader reader = &TDelayProcessor::template readWith<LinearInterpolator>;
+  int points = LinearInterpolator::POINTS;
+  int lookahead = LinearInterpolator::LOOKAHEAD;
+  TInterpolationState<T> state;
 
   float delayTimeParam = 0.5f;
   float feedbackParam = 0.0f;
+  float timeModulation = 0.0f; // Added to delayTimeParam
+  int latency = 0;              // Frames taken off the delay time
+  bool modulated = false;      // Size the line for any modulation
 
   float actualTime = 0.5f;
   bool dirty = true;
 
-  float readBuffer(const std::vector<float> &buffer, float delaySamples) {
-    size_t size = buffer.size();
-    if (delaySamples < 1.0f)
-      delaySamples = 1.0f;
-    if (delaySamples > (float)size - 3.0f)
-      delaySamples = (float)size - 3.0f;
+  int glide = GLIDE_TAPE;
+  float glideTime = 0.1f; // Seconds, tape time constant or crossfade length
+
+  // Delays in samples. headDelay is where the head is at the start of the
+  // next block, negative until the first one.
+  float targetDelay = 0.0f;
+  float headDelay = -1.0f;
+  float lastSampleRate = 0.0f;
+
+  // Second head while crossfading
+  bool fading = false;
+  float fadeDelay = 0.0f;
+  float fadeGain = 0.0f;
+  TInterpolationState<T> fadeState;
+
+  static float timeFromParam(float p) {
+    float k1 = std::max(0.0f, std::min(1.0f, p));
+    return std::exp(std::log(0.001f) +
+                    k1 * (std::log(10.0f) - std::log(0.001f)));
+  }
+
+  // The kernel's oldest point has to be in the line, and its newest one
+  // already written
+  float clampDelay(float delaySamples, const TDelayLine<T> &source) const {
+    float size = (float)source.getCapacity();
+    if (delaySamples > size - (float)(points + 1))
+      delaySamples = size - (float)(points + 1);
+    if (delaySamples < (float)(1 + lookahead))
+      delaySamples = (float)(1 + lookahead);
+    return delaySamples;
+  }
+
+  template <typename K> void useKernel() {
+    static_assert(K::POINTS - 1 <= (int)TDelayLine<T>::GUARD,
+                  "kernel must fit in a page and its guard frames");
+    reader = &TDelayProcessor::template readWith<K>;
+    points = K::POINTS;
+    lookahead = K::LOOKAHEAD;
+    dirty = true;
+    state = TInterpolationState<T>();
+    fadeState = TInterpolationState<T>();
+  }
+
+  // Reads with the delay moving linearly from `from` to `to` over the block.
+  // A fixed delay gets its weights once, a moving one once per frame.
+  template <typename K>
+  void readWith(const TDelayLine<T> &source, T *left, T *right, int frames,
+                float from, float to, TInterpolationState<T> &st) {
+    if (!source.isAllocated()) {
+      std::fill(left, left + frames, 0.f);
+      std::fill(right, right + frames, 0.f);
+      return;
+    }
+    float w[K::POINTS];
+    if (from == to) {
+      float whole = std::floor(from);
+      K::weights(from - whole, w);
+      size_t age = (size_t)whole + K::POINTS - 1 - K::LOOKAHEAD;
+      for (int i = 0; i < frames; i++)
+        K::apply(source.frames(i, age), w, st, left[i], right[i]);
+      return;
+    }
+    float step = (to - from) / (float)frames;
+    for (int i = 0; i < frames; i++) {
+      float d = from + step * (float)i;
+      float whole = std::floor(d);
+      K::weights(d - whole, w);
+      size_t age = (size_t)whole + K::POINTS - 1 - K::LOOKAHEAD;
+      K::apply(source.frames(i, age), w, st, left[i], right[i]);
+    }
+  }
 
-    float readPos = (float)writeIndex - delaySamples;
-    while (readPos < 0)
-      readPos += (float)size;
+  // Control rate part: the only exp() is here, and it only runs when the
+  // knob, the modulation or the sample rate changed.
+  void updateTime(float sampleRate) {
+    if (dirty || sampleRate != lastSampleRate) {
+      actualTime = timeFromParam(delayTimeParam + timeModulation);
+      targetDelay = compensate(actualTime * sampleRate);
+      if (headDelay >= 0.0f && lastSampleRate > 0.0f) {
+        headDelay *= sampleRate / lastSampleRate;
+        fadeDelay *= sampleRate / lastSampleRate;
+      }
+      lastSampleRate = sampleRate;
+      dirty = false;
+    }
+    if (headDelay < 0.0f)
+      headDelay = targetDelay;
+  }
 
-    int i1 = (int)readPos;
-    int i2 = (i1 + 1) % size;
-    float frac = readPos - (float)i1;
+  // Takes the latency off a delay in samples, but not below one control
+  // block plus the kernel's look-ahead, so the compensation alone never
+  // makes getCausalFrames() shorter than MIN_COMPENSATED_FRAMES. Delays
+  // already shorter than that are left as they are.
+  float compensate(float delaySamples) const {
+    float shortest = (float)(MIN_COMPENSATED_FRAMES + lookahead);
+    return std::max(delaySamples - (float)latency,
+                    std::min(delaySamples, shortest));
+  }
 
-    return buffer[i1] * (1.0f - frac) + buffer[i2] * frac;
+  // Shortest delay any head can have during the next block
+  float getMinDelay() const {
+    float d = std::min(headDelay, targetDelay);
+    return fading ? std::min(d, fadeDelay) : d;
+  }
+
+  void readTape(const TDelayLine<T> &source, T *left, T *right,
+                int frames, float sampleRate) {
+    float to = clampDelay(targetDelay, source);
+    float from = glideTime > 0.0f ? clampDelay(headDelay, source) : to;
+    if (from != to) {
+      // One pole towards the target, stepped once per block
+      float k = std::exp(-(float)frames / (glideTime * sampleRate));
+      to = to + (from - to) * k;
+      if (std::fabs(to - targetDelay) < 1e-3f)
+        to = clampDelay(targetDelay, source);
+    }
+    (this->*reader)(source, left, right, frames, from, to, state);
+    headDelay = to;
+  }
+
+  void readCrossfade(const TDelayLine<T> &source, T *left, T *right,
+                     int frames, float sampleRate) {
+    if (!fading && headDelay != targetDelay) {
+      // Not worth a crossfade for less than a sample
+      if (glideTime <= 0.0f || std::fabs(headDelay - targetDelay) < 1.0f) {
+        headDelay = targetDelay;
+      } else {
+        fading = true;
+        fadeDelay = targetDelay;
+        fadeGain = 0.0f;
+        fadeState = state;
+      }
+    }
+    float delay = clampDelay(headDelay, source);
+    (this->*reader)(source, left, right, frames, delay, delay, state);
+    if (!fading)
+      return;
+
+    float step = 1.0f / (glideTime * sampleRate);
+    float fadeDelayClamped = clampDelay(fadeDelay, source);
+    T bufL[32], bufR[32];
+    for (int offset = 0; offset < frames; offset += 32) {
+      int n = std::min(32, frames - offset);
+      (this->*reader)(source, bufL, bufR, n, fadeDelayClamped,
+                      fadeDelayClamped, fadeState);
+      T *l = left + offset;
+      T *r = right + offset;
+      for (int i = 0; i < n; i++) {
+        float g = std::min(1.0f, fadeGain + step * (float)(offset + i));
+        l[i] += (bufL[i] - l[i]) * g;
+        r[i] += (bufR[i] - r[i]) * g;
+      }
+    }
+    fadeGain += step * (float)frames;
+    if (fadeGain >= 1.0f) {
+      fading = false;
+      headDelay = fadeDelay;
+      state = fadeState;
+    }
   }
 
 public:
-  DelayProcessor(size_t size) {
-    bufferL.resize(size, 0.0f);
-    bufferR.resize(size, 0.0f);
+  TDelayProcessor(size_t maxSize) : line(maxSize) {
+    // Built here rather than on the first audio block that needs it
+    SincInterpolator::table();
+  }
+
+  // Picks the fractional delay kernel. Cheap, but it resets the allpass
+  // memory, so only call it when the choice actually changes.
+  void setInterpolation(int mode) {
+    interpolation = mode;
+    switch (mode) {
+    case INTERP_LAGRANGE3:
+      useKernel<Lagrange3Interpolator>();
+      break;
+    case INTERP_HERMITE:
+      useKernel<HermiteInterpolator>();
+      break;
+    case INTERP_ALLPASS:
+      useKernel<AllpassInterpolator>();
+      break;
+    case INTERP_SINC:
+      useKernel<SincInterpolator>();
+      break;
+    default:
+      interpolation = INTERP_LINEAR;
+      useKernel<LinearInterpolator>();
+      break;
+    }
   }
+  int getInterpolation() const { return interpolation; }
 
   void setParams(float p1, float p2) {
     if (p1 != delayTimeParam || p2 != feedbackParam) {
@@ -51,24 +261,95 @@ public:
 
   float getFeedbackAmount() const { return feedbackParam; }
 
-  void read(float &left, float &right, float sampleRate) {
-    if (dirty) {
-      float k1 = std::max(0.0f, std::min(1.0f, delayTimeParam));
-      actualTime = std::exp(std::log(0.001f) +
-                            k1 * (std::log(10.0f) - std::log(0.001f)));
-      dirty = false;
+  // Offset added to the delay time knob, e.g. from a CV input. Meant to be
+  // updated once per block.
+  void setTimeModulation(float amount) {
+    if (amount != timeModulation) {
+      timeModulation = amount;
+      dirty = true;
     }
-    left = readBuffer(bufferL, actualTime * sampleRate);
-    right = readBuffer(bufferR, actualTime * sampleRate);
   }
 
-  void write(float left, float right) {
-    bufferL[writeIndex] = left;
-    bufferR[writeIndex] = right;
-    writeIndex++;
-    if (writeIndex >= bufferL.size())
-      writeIndex = 0;
+  // Frames the chain after the read head delays the signal by. They are
+  // taken off the delay time, so the tap still lands on it as long as the
+  // delay is at least latency + MIN_COMPENSATED_FRAMES + the look-ahead,
+  // about 1.7 ms at 48 kHz behind the shifter's FIR. Shorter delays come out
+  // up to `frames` late.
+  void setLatency(int frames) {
+    if (frames != latency) {
+      latency = frames;
+      dirty = true;
+    }
+  }
+
+  // While modulated, the line is sized for the longest delay time, since the
+  // modulation can reach it without a chance to reserve().
+  void setModulated(bool on) { modulated = on; }
+
+  void setGlide(int mode, float seconds) {
+    if (mode != glide)
+      fading = false;
+    glide = mode;
+    glideTime = std::max(0.0f, seconds);
+  }
+
+  // Grows the delay memory to fit the current delay time. Allocates, so call
+  // it from the UI thread whenever the delay time or sample rate changes.
+  void reserve(float sampleRate) { line.reserve(getRequiredFrames(sampleRate)); }
+  // Same, for a size the caller worked out with requiredFrames()
+  void reserveFrames(size_t frames) { line.reserve(frames); }
+
+  // Frames of history a delay time knob value needs at `sampleRate`. Lets
+  // the UI thread size a line from its own copy of the knob.
+  static size_t requiredFrames(float delayParam, float sampleRate) {
+    // Room for the longest kernel
+    return (size_t)(timeFromParam(delayParam) * sampleRate) +
+           SincInterpolator::POINTS + 2;
   }
+
+  // Frames of history the current delay time needs at `sampleRate`
+  size_t getRequiredFrames(float sampleRate) const {
+    return requiredFrames(modulated ? 1.0f : delayTimeParam, sampleRate);
+  }
+
+  size_t getMemoryFrames() const { return line.getCapacity(); }
+
+  // Number of frames that can be read before any of them depends on a frame
+  // that is yet to be written, i.e. the shortest delay time the heads pass
+  // through in samples, minus the kernel's look-ahead.
+  int getCausalFrames(float sampleRate) {
+    return getCausalFrames(line, sampleRate);
+  }
+  int getCausalFrames(const TDelayLine<T> &source, float sampleRate) {
+    updateTime(sampleRate);
+    return std::max(1, (int)clampDelay(getMinDelay(), source) - lookahead);
+  }
+
+  void read(T &left, T &right, float sampleRate) {
+    readBlock(&left, &right, 1, sampleRate);
+  }
+
+  // Reads `frames` consecutive frames starting at the current write position.
+  // Callers must not read more than getCausalFrames() before writing back.
+  void readBlock(T *left, T *right, int frames, float sampleRate) {
+    line.commit();
+    readBlock(line, left, right, frames, sampleRate);
+  }
+
+  // Same as above, but with this processor acting as a read head on a line
+  // owned and written by someone else.
+  void readBlock(const TDelayLine<T> &source, T *left, T *right, int frames,
+                 float sampleRate) {
+    updateTime(sampleRate);
+    if (glide == GLIDE_CROSSFADE)
+      readCrossfade(source, left, right, frames, sampleRate);
+    else
+      readTape(source, left, right, frames, sampleRate);
+  }
+
+  void write(T left, T right) { line.write(left, right); }
 };
 
+typedef TDelayProcessor<float> DelayProcessor;
+
 } // namespace paisa
@@ -0,0 +1,72 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace paisa {
+
+// Makes the calling thread flush denormals to zero, as Rack does on its
+// engine threads. Without it, decaying tails and silent inputs turn into
+// denormal arithmetic, which runs many times slower.
+inline void flushDenormals() {
+#if defined(__SSE__)
+  _mm_setcsr(_mm_getcsr() | 0x8040); // FTZ and DAZ
+#elif defined(__aarch64__)
+  uint64_t fpcr;
+  asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+  asm volatile("msr fpcr, %0" : : "r"(fpcr | (1 << 24))); // FZ
+#endif
+}
+
+/**
+ * Flushes denormals to zero until the end of the scope, then puts back the
+ * caller's floating point mode. Hosts normally set the mode already, so the
+ * usual cost is one read of the control register.
+ */
+class ScopedFlushDenormals {
+public:
+#if defined(__SSE__)
+  ScopedFlushDenormals() : saved(_mm_getcsr()) {
+    if ((saved & 0x8040) != 0x8040)
+      _mm_setcsr(saved | 0x8040);
+  }
+  ~ScopedFlushDenormals() {
+    if ((saved & 0x8040) != 0x8040)
+      _mm_setcsr(saved);
+  }
+
+private:
+  unsigned int saved;
+#elif defined(__aarch64__)
+  ScopedFlushDenormals() {
+    asm volatile("mrs %0, fpcr" : "=r"(saved));
+    if (!(saved & (1 << 24)))
+      asm volatile("msr fpcr, %0" : : "r"(saved | (1 << 24)));
+  }
+  ~ScopedFlushDenormals() {
+    if (!(saved & (1 << 24)))
+      asm volatile("msr fpcr, %0" : : "r"(saved));
+  }
+
+private:
+  uint64_t saved;
+#else
+  ScopedFlushDenormals() {}
+#endif
+
+  ScopedFlushDenormals(const ScopedFlushDenormals &) = delete;
+  ScopedFlushDenormals &operator=(const ScopedFlushDenormals &) = delete;
+};
+
+// Recursive state below this is silence and gets zeroed. It is far above the
+// denormal range, so state flushed once per block can't decay into it before
+// the next flush, whatever the floating point mode.
+constexpr float DENORMAL_THRESHOLD = 1e-15f;
+
+inline float flushDenormal(float x) {
+  return std::fabs(x) < DENORMAL_THRESHOLD ? 0.f : x;
+}
+
+} // namespace paisa
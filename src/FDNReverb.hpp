@@ -1,4 +1,5 @@
 #pragma once
+#include "Denormals.hpp"
 #include <algorithm>
 #include <cmath>
 #include <vector>
@@ -150,7 +151,8 @@ public:
       // Homogeneous decay gain gamma applied per line relative to its length
       // wait, if gamma is per-sample, gain is gamma^delay
       float gi = std::pow(gamma, delays4[i]);
-      buffer4[i][writeIndex4[i]] = in + v4[i] * gi;
+      // Flushed as written, the lines are the whole state of the network
+      buffer4[i][writeIndex4[i]] = flushDenormal(in + v4[i] * gi);
       writeIndex4[i] = (writeIndex4[i] + 1) % buffer4[i].size();
       out4 += delayed4[i] * 0.25f;
     }
@@ -173,7 +175,7 @@ public:
     float out8 = 0.0f;
     for (int i = 0; i < N8; ++i) {
       float gi = std::pow(gamma, delays8[i]);
-      buffer8[i][writeIndex8[i]] = in + v8[i] * gi;
+      buffer8[i][writeIndex8[i]] = flushDenormal(in + v8[i] * gi);
       writeIndex8[i] = (writeIndex8[i] + 1) % buffer8[i].size();
       out8 += delayed8[i] * 0.125f;
     }
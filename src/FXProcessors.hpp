@@ -5,32 +5,48 @@
 
 namespace paisa {
 
-class FX1Processor : public Processor {
+template <typename T> class TFX1Processor : public TProcessor<T> {
 private:
-  FrequencyShifter shifter;
+  TFrequencyShifter<T> shifter;
 
 public:
   void setParams(float p1, float p2) override { shifter.setParams(p1, p2); }
   void setParams(float p1, float p2, float p3) override {
     shifter.setParams(p1, p2);
   }
-  void process(float &left, float &right, float sampleRate) override {
+  // One of TQuadrature::Mode
+  void setHilbert(int mode) { shifter.setHilbert(mode); }
+  int getLatency() const { return shifter.getLatency(); }
+  // One of TFrequencyShifter::Stereo
+  void setStereo(int mode) { shifter.setStereo(mode); }
+  void process(T &left, T &right, float sampleRate) override {
     shifter.process(left, right, sampleRate);
   }
+  void processBlock(T *left, T *right, int frames,
+                    float sampleRate) override {
+    shifter.processBlock(left, right, frames, sampleRate);
+  }
 };
 
-class FX2Processor : public Processor {
+template <typename T> class TFX2Processor : public TProcessor<T> {
 private:
-  Phaser phaser;
+  TPhaser<T> phaser;
 
 public:
   void setParams(float p1, float p2) override { phaser.setParams(p1, p2); }
   void setParams(float p1, float p2, float p3) override {
     phaser.setParams(p1, p2, p3);
   }
-  void process(float &left, float &right, float sampleRate) override {
+  void process(T &left, T &right, float sampleRate) override {
     phaser.process(left, right, sampleRate);
   }
+  void processBlock(T *left, T *right, int frames,
+                    float sampleRate) override {
+    phaser.processBlock(left, right, frames, sampleRate);
+  }
 };
 
+typedef TFX1Processor<float> FX1Processor;
+typedef TFX2Processor<float> FX2Processor;
+
 } // namespace paisa
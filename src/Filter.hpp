@@ -1,17 +1,25 @@
 #pragma once
+#include "SimdSupport.hpp"
 #include <rack.hpp>
 
 namespace paisa {
 
 /**
  * Efficient State Variable Filter (Trapezoidal / Simper)
+ * The state is T (float or float_4 voices). The coefficients C are shared by
+ * default, or float_4 to give every lane its own filter.
  */
-struct SVF {
-  float s1 = 0.f, s2 = 0.f;
-  float g = 0.f, k = 0.f;
-  float a1 = 0.f, a2 = 0.f, a3 = 0.f;
+template <typename T, typename C = float> struct TSVF {
+  T s1 = 0.f, s2 = 0.f;
+  C g = 0.f, k = 0.f;
+  C a1 = 0.f, a2 = 0.f, a3 = 0.f;
 
   void reset() { s1 = s2 = 0.f; }
+  // Once per block, so a silent input decays to zero
+  void flushDenormals() {
+    s1 = flushDenormal(s1);
+    s2 = flushDenormal(s2);
+  }
 
   void setParams(float freq, float res) {
     // freq: normalized frequency [0, 0.5]
@@ -23,10 +31,10 @@ struct SVF {
     a3 = g * a2;
   }
 
-  void process(float x, float &low, float &high, float &band) {
-    float v3 = x - s2;
-    float v1 = a1 * s1 + a2 * v3;
-    float v2 = s2 + a2 * s1 + a3 * v3;
+  void process(T x, T &low, T &high, T &band) {
+    T v3 = x - s2;
+    T v1 = a1 * s1 + a2 * v3;
+    T v2 = s2 + a2 * s1 + a3 * v3;
     s1 = 2.0f * v1 - s1;
     s2 = 2.0f * v2 - s2;
     low = v2;
@@ -40,15 +48,20 @@ struct SVF {
  * Base: Controls the High-Pass cutoff frequency.
  * Width: Controls the range above Base for the Low-Pass cutoff frequency.
  */
-struct BaseWidthFilter {
-  SVF hp_filter;
-  SVF lp_filter;
+template <typename T, typename C = float> struct TBaseWidthFilter {
+  TSVF<T, C> hp_filter;
+  TSVF<T, C> lp_filter;
 
   void reset() {
     hp_filter.reset();
     lp_filter.reset();
   }
 
+  void flushDenormals() {
+    hp_filter.flushDenormals();
+    lp_filter.flushDenormals();
+  }
+
   void setParams(float sampleRate, float baseFreq, float widthRange) {
     float f1 = baseFreq / sampleRate;
     // Map width (0-100) to an octave range (e.g., 0 to 10 octaves)
@@ -59,9 +72,9 @@ struct BaseWidthFilter {
     lp_filter.setParams(f2, 0.0f); // LP component (width extension)
   }
 
-  float process(float x) {
-    float l1, h1, b1;
-    float l2, h2, b2;
+  T process(T x) {
+    T l1, h1, b1;
+    T l2, h2, b2;
     hp_filter.process(x, l1, h1, b1);
     lp_filter.process(x, l2, h2, b2);
 
@@ -72,4 +85,7 @@ struct BaseWidthFilter {
   }
 };
 
+typedef TSVF<float> SVF;
+typedef TBaseWidthFilter<float> BaseWidthFilter;
+
 } // namespace paisa
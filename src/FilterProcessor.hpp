@@ -6,15 +6,16 @@
 
 namespace paisa {
 
-class FilterProcessor : public Processor {
-  BaseWidthFilter filterL;
-  BaseWidthFilter filterR;
+template <typename T> class TFilterProcessor : public TProcessor<T> {
+  TBaseWidthFilter<T> filterL;
+  TBaseWidthFilter<T> filterR;
   float normalizedFreq = 0.5f;
   float normalizedWidth = 0.5f;
   float lastSampleRate = -1.0f;
   float lastFreq = -1.0f;
   float lastWidth = -1.0f;
   bool dirty = true;
+  StageBypass bypass;
 
 public:
   void setParams(float p1, float p2) override {
@@ -25,35 +26,69 @@ public:
     }
   }
 
-  void process(float &left, float &right, float sampleRate) override {
-    // Only update filter coefficients if parameters or sample rate changed
-    if (dirty || sampleRate != lastSampleRate) {
-      // Clip the implementation for algorithm safety
-      float k1 = std::max(0.0f, std::min(1.0f, normalizedFreq));
-      float k2 = std::max(0.0f, std::min(1.0f, normalizedWidth));
-
-      // Logarithmic curve for frequency (Octaves)
-      float f =
-          std::exp(std::log(20.f) + k1 * (std::log(20000.f) - std::log(20.f)));
-
-      // Octave-based width offset (Consistent window feel)
-      // k2 = 0 -> HP and LP coincide (Filter bypassed/spike)
-      // k2 = 1 -> LP is 10 octaves above HP
-      float w = k2 * 100.f;
-
-      if (f != lastFreq || w != lastWidth || sampleRate != lastSampleRate) {
-        filterL.setParams(sampleRate, f, w);
-        filterR.setParams(sampleRate, f, w);
-        lastFreq = f;
-        lastWidth = w;
-        lastSampleRate = sampleRate;
-      }
-      dirty = false;
-    }
-
+  void process(T &left, T &right, float sampleRate) override {
+    updateCoefficients(sampleRate);
     left = filterL.process(left);
     right = filterR.process(right);
   }
+
+  void processBlock(T *left, T *right, int frames,
+                    float sampleRate) override {
+    updateCoefficients(sampleRate);
+    bool wake;
+    if (!bypass.begin(isNeutral(normalizedFreq, normalizedWidth), sampleRate,
+                      wake))
+      return;
+    if (wake) {
+      filterL.reset();
+      filterR.reset();
+    }
+    bypass.run(left, frames, [&](T x) { return filterL.process(x); });
+    bypass.run(right, frames, [&](T x) { return filterR.process(x); });
+    bypass.end(frames);
+    filterL.flushDenormals();
+    filterR.flushDenormals();
+  }
+
+  // Base at the bottom and full width: the band covers 20 Hz to beyond
+  // 20 kHz, which the chain takes as no filtering at all
+  static bool isNeutral(float p1, float p2) { return p1 <= 0.f && p2 >= 1.f; }
+
+  // Knob positions to the base frequency in Hz and the width (0-100)
+  static void mapParams(float p1, float p2, float &freq, float &width) {
+    // Clip the implementation for algorithm safety
+    float k1 = std::max(0.0f, std::min(1.0f, p1));
+    float k2 = std::max(0.0f, std::min(1.0f, p2));
+
+    // Logarithmic curve for frequency (Octaves)
+    freq =
+        std::exp(std::log(20.f) + k1 * (std::log(20000.f) - std::log(20.f)));
+
+    // Octave-based width offset (Consistent window feel)
+    // k2 = 0 -> HP and LP coincide (Filter bypassed/spike)
+    // k2 = 1 -> LP is 10 octaves above HP
+    width = k2 * 100.f;
+  }
+
+private:
+  void updateCoefficients(float sampleRate) {
+    // Only update filter coefficients if parameters or sample rate changed
+    if (!dirty && sampleRate == lastSampleRate)
+      return;
+    float f, w;
+    mapParams(normalizedFreq, normalizedWidth, f, w);
+
+    if (f != lastFreq || w != lastWidth || sampleRate != lastSampleRate) {
+      filterL.setParams(sampleRate, f, w);
+      filterR.setParams(sampleRate, f, w);
+      lastFreq = f;
+      lastWidth = w;
+      lastSampleRate = sampleRate;
+    }
+    dirty = false;
+  }
 };
 
+typedef TFilterProcessor<float> FilterProcessor;
+
 } // namespace paisa
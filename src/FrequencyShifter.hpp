@@ -1,4 +1,5 @@
 #pragma once
+#include "SimdSupport.hpp"
 #include <algorithm>
 #include <cmath>
 #include <rack.hpp>
@@ -15,51 +16,82 @@ namespace paisa {
  * Uses a Nuttall window for ultra-high sidelobe rejection (-93 dB).
  * Transition band width: ~370 Hz at 48 kHz.
  * Group delay: (127 - 1) / 2 = 63 samples.
+ *
+ * Every other tap of the kernel is zero, so each output only reads the past
+ * inputs of the same parity as the newest one. The input is split into its
+ * even and odd samples, and each half is written twice, HALF apart, so the
+ * 64 nonzero taps are one contiguous dot product with no wrap.
  */
-class FIRHilbert {
+template <typename T> class TFIRHilbert {
 private:
   static constexpr int TAPS = 127;
   static constexpr int M = 63;
-  float kernel[TAPS];
-  float buffer[TAPS];
+  static constexpr int HALF = (TAPS + 1) / 2;
+  // Nonzero taps, oldest input first
+  float kernel[HALF];
+  T history[2][2 * HALF];
   int writeIdx = 0;
+  int parity = 0;
+
+  static float dot(const float *x, const float *k) {
+    float_4 a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+    for (int i = 0; i < HALF; i += 16) {
+      a0 += float_4::load(x + i) * float_4::load(k + i);
+      a1 += float_4::load(x + i + 4) * float_4::load(k + i + 4);
+      a2 += float_4::load(x + i + 8) * float_4::load(k + i + 8);
+      a3 += float_4::load(x + i + 12) * float_4::load(k + i + 12);
+    }
+    float_4 a = (a0 + a1) + (a2 + a3);
+    return (a[0] + a[1]) + (a[2] + a[3]);
+  }
+  static float_4 dot(const float_4 *x, const float *k) {
+    float_4 a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+    for (int i = 0; i < HALF; i += 4) {
+      a0 += x[i] * k[i];
+      a1 += x[i + 1] * k[i + 1];
+      a2 += x[i + 2] * k[i + 2];
+      a3 += x[i + 3] * k[i + 3];
+    }
+    return (a0 + a1) + (a2 + a3);
+  }
 
 public:
-  FIRHilbert() {
-    std::fill(buffer, buffer + TAPS, 0.0f);
+  TFIRHilbert() {
+    reset();
     for (int n = 0; n < TAPS; n++) {
       int k = n - M;
-      if (k == 0 || (k % 2 == 0)) {
-        kernel[n] = 0.0f;
-      } else {
-        // Nuttall window coefficients
-        const float a0 = 0.355768f;
-        const float a1 = 0.487396f;
-        const float a2 = 0.144232f;
-        const float a3 = 0.012604f;
-
-        float window = a0 - a1 * std::cos(2.0f * M_PI * n / (TAPS - 1)) +
-                       a2 * std::cos(4.0f * M_PI * n / (TAPS - 1)) -
-                       a3 * std::cos(6.0f * M_PI * n / (TAPS - 1));
-
-        // Ideal Hilbert: 2 / (pi * k)
-        kernel[n] = window * (2.0f / (M_PI * (float)k));
-      }
+      if (k == 0 || (k % 2 == 0))
+        continue;
+      // Nuttall window coefficients
+      const float a0 = 0.355768f;
+      const float a1 = 0.487396f;
+      const float a2 = 0.144232f;
+      const float a3 = 0.012604f;
+
+      float window = a0 - a1 * std::cos(2.0f * M_PI * n / (TAPS - 1)) +
+                     a2 * std::cos(4.0f * M_PI * n / (TAPS - 1)) -
+                     a3 * std::cos(6.0f * M_PI * n / (TAPS - 1));
+
+      // Ideal Hilbert: 2 / (pi * k), at n samples back
+      kernel[HALF - 1 - n / 2] = window * (2.0f / (M_PI * (float)k));
     }
   }
 
-  float process(float x) {
-    buffer[writeIdx] = x;
-    float sum = 0.0f;
-    for (int i = 0; i < TAPS; i++) {
-      int readIdx = writeIdx - i;
-      if (readIdx < 0)
-        readIdx += TAPS;
-      sum += buffer[readIdx] * kernel[i];
-    }
-    writeIdx = (writeIdx + 1) % TAPS;
+  T process(T x) {
+    T *h = history[parity];
+    h[writeIdx] = x;
+    h[writeIdx + HALF] = x;
+    T sum = dot(h + writeIdx + 1, kernel);
+    parity ^= 1;
+    if (parity == 0)
+      writeIdx = (writeIdx + 1) % HALF;
     return sum;
   }
+
+  void reset() {
+    std::fill(history[0], history[0] + 2 * HALF, T(0.0f));
+    std::fill(history[1], history[1] + 2 * HALF, T(0.0f));
+  }
 };
 
 /**
@@ -67,25 +99,152 @@ public:
  * Delays the real path by 63 samples to align with the 127-tap FIR Hilbert
  * branch.
  */
-class MatchingDelay {
-private:
+template <typename T> class TMatchingDelay {
+public:
   static constexpr int DELAY = 63;
-  float buffer[DELAY + 1];
+
+private:
+  T buffer[DELAY];
   int writeIdx = 0;
 
 public:
-  MatchingDelay() { std::fill(buffer, buffer + DELAY + 1, 0.0f); }
-  float process(float x) {
-    float out = buffer[writeIdx];
+  TMatchingDelay() { reset(); }
+  void reset() { std::fill(buffer, buffer + DELAY, T(0.0f)); }
+  T process(T x) {
+    T out = buffer[writeIdx];
     buffer[writeIdx] = x;
-    writeIdx = (writeIdx + 1) % (DELAY + 1);
+    if (++writeIdx == DELAY)
+      writeIdx = 0;
     return out;
   }
 };
 
-class BiquadHPF {
+/**
+ * IIR Hilbert pair: two chains of four allpasses in z^-2, 90 degrees apart
+ * within about 0.7 degrees from 0.0005 to 0.4995 of the sample rate (Olli
+ * Niemitalo's coefficients). Eight multiplies a sample and no added
+ * latency, but both outputs are allpass, so the phase of the pair against
+ * the input varies with frequency.
+ */
+template <typename T> class TIIRHilbert {
 private:
-  float z1 = 0.0f, z2 = 0.0f;
+  static constexpr int SECTIONS = 4;
+  float a[2][SECTIONS];
+  // Per chain and input parity, the input and every section output two
+  // samples back. Each allpass only mixes samples of one parity.
+  T state[2][2][SECTIONS + 1];
+  T delayedIm = 0.0f;
+  int parity = 0;
+
+  T chain(int c, T x) {
+    T *z = state[c][parity];
+    for (int s = 0; s < SECTIONS; s++) {
+      T y = a[c][s] * (x + z[s + 1]) - z[s];
+      z[s] = x;
+      x = y;
+    }
+    z[SECTIONS] = x;
+    return x;
+  }
+
+public:
+  TIIRHilbert() {
+    static const float coefficients[2][SECTIONS] = {
+        {0.6923878f, 0.9360654322959f, 0.9882295226860f, 0.9987488452737f},
+        {0.4021921162426f, 0.8561710882420f, 0.9722909545651f,
+         0.9952884791278f}};
+    for (int c = 0; c < 2; c++) {
+      for (int s = 0; s < SECTIONS; s++)
+        a[c][s] = coefficients[c][s] * coefficients[c][s];
+    }
+    reset();
+  }
+
+  // The first chain, one sample late, lags the second by 90 degrees
+  void process(T x, T &re, T &im) {
+    im = delayedIm;
+    delayedIm = chain(0, x);
+    re = chain(1, x);
+    parity ^= 1;
+  }
+
+  void flushDenormals() {
+    for (int c = 0; c < 2; c++) {
+      for (int p = 0; p < 2; p++) {
+        for (int s = 0; s <= SECTIONS; s++)
+          state[c][p][s] = flushDenormal(state[c][p][s]);
+      }
+    }
+    delayedIm = flushDenormal(delayedIm);
+  }
+
+  void reset() {
+    for (int c = 0; c < 2; c++) {
+      for (int p = 0; p < 2; p++)
+        std::fill(state[c][p], state[c][p] + SECTIONS + 1, T(0.0f));
+    }
+    delayedIm = 0.0f;
+  }
+};
+
+/**
+ * Splits a signal into a real and an imaginary part 90 degrees apart, with
+ * the FIR Hilbert and its matching delay, or with the IIR pair.
+ */
+template <typename T> class TQuadrature {
+public:
+  enum Mode { HILBERT_FIR, HILBERT_IIR, NUM_HILBERT_MODES };
+
+private:
+  TFIRHilbert<T> fir;
+  TMatchingDelay<T> delay;
+  TIIRHilbert<T> iir;
+  int mode = HILBERT_FIR;
+
+public:
+  // Clears the state when the mode changes
+  void setMode(int m) {
+    m = rack::math::clamp(m, 0, NUM_HILBERT_MODES - 1);
+    if (m == mode)
+      return;
+    mode = m;
+    reset();
+  }
+  int getMode() const { return mode; }
+
+  // Samples both parts lag the input by, none for the IIR pair, which only
+  // shifts the phase
+  int getLatency() const {
+    if (mode == HILBERT_IIR)
+      return 0;
+    return TMatchingDelay<T>::DELAY;
+  }
+
+  void process(T x, T &re, T &im) {
+    if (mode == HILBERT_IIR) {
+      iir.process(x, re, im);
+    } else {
+      re = delay.process(x);
+      im = fir.process(x);
+    }
+  }
+
+  // The FIR and matching delay only hold past input, the IIR pair recurses
+  void flushDenormals() {
+    if (mode == HILBERT_IIR)
+      iir.flushDenormals();
+  }
+
+  void reset() {
+    fir.reset();
+    delay.reset();
+    iir.reset();
+  }
+};
+
+template <typename T> class TBiquadHPF {
+private:
+  T z1 = 0.0f, z2 = 0.0f;
   float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
 
 public:
@@ -103,161 +262,356 @@ public:
     a2 = (1.0f - alpha) / a0;
   }
 
-  float process(float x) {
-    float out = b0 * x + z1;
+  T process(T x) {
+    T out = b0 * x + z1;
     z1 = b1 * x - a1 * out + z2;
     z2 = b2 * x - a2 * out;
-    if (!std::isfinite(z1))
-      z1 = 0.0f;
-    if (!std::isfinite(z2))
-      z2 = 0.0f;
+    z1 = sanitize(z1);
+    z2 = sanitize(z2);
     return out;
   }
+  void flushDenormals() {
+    z1 = flushDenormal(z1);
+    z2 = flushDenormal(z2);
+  }
+  void reset() { z1 = z2 = 0.0f; }
 };
 
-class OnePoleLPF {
+template <typename T> class TOnePoleLPF {
 private:
-  float y_z1 = 0.0f;
+  T y_z1 = 0.0f;
 
 public:
-  float process(float x, float k) {
+  T process(T x, T k) {
     y_z1 = y_z1 + k * (x - y_z1);
-    if (!std::isfinite(y_z1))
-      y_z1 = 0.0f;
+    y_z1 = sanitize(y_z1);
     return y_z1;
   }
+  void flushDenormals() { y_z1 = flushDenormal(y_z1); }
+  void reset() { y_z1 = 0.0f; }
 };
 
-class FrequencyShifter {
+/**
+ * How TFrequencyShifter lays a stereo frame out in float_4 vectors. With
+ * T = float, left and right share one vector, in lanes 0 and 1. With
+ * T = float_4 every lane is a voice, so each channel is a vector.
+ */
+template <typename T> struct TStereoFrames;
+
+template <> struct TStereoFrames<float> {
+  static constexpr int VECTORS = 1;
+  static void pack(float left, float right, float_4 *v) {
+    v[0] = float_4(left, right, 0.0f, 0.0f);
+  }
+  static void unpack(const float_4 *v, float &left, float &right) {
+    left = v[0][0];
+    right = v[0][1];
+  }
+  // 1 in the lanes of vector k that carry the right channel
+  static float_4 rightLanes(int k) { return float_4(0.0f, 1.0f, 0.0f, 0.0f); }
+};
+
+template <> struct TStereoFrames<float_4> {
+  static constexpr int VECTORS = 2;
+  static void pack(float_4 left, float_4 right, float_4 *v) {
+    v[0] = left;
+    v[1] = right;
+  }
+  static void unpack(const float_4 *v, float_4 &left, float_4 &right) {
+    left = v[0];
+    right = v[1];
+  }
+  static float_4 rightLanes(int k) { return k == 1 ? 1.0f : 0.0f; }
+};
+
+/**
+ * Single sideband frequency shifter. With T = float, left and right run
+ * side by side in one float_4. With T = float_4 every lane is a voice.
+ * P holds the knobs, the smoothing and the oscillator: with P = float the
+ * lanes share them, with P = float_4 each lane of T = float_4 has its own,
+ * as the TapBank runs one tap per lane.
+ */
+template <typename T, typename P = float> class TFrequencyShifter {
+public:
+  // Longest run of frames between two control rate updates
+  static constexpr int CONTROL_FRAMES = 16;
+
+  // How the right channel's oscillator relates to the left one
+  enum Stereo { STEREO_LINKED, STEREO_SPREAD, NUM_STEREO_MODES };
+
 private:
-  FIRHilbert hilbertL, hilbertR;
-  MatchingDelay delayL, delayR;
-  BiquadHPF hpfL, hpfR;
-  OnePoleLPF postL, postR;
-
-  // Independent oscillators for stereo channels
-  float osc_cL = 1.0f, osc_sL = 0.0f;
-  float osc_cR = 1.0f, osc_sR = 0.0f;
+  typedef TStereoFrames<T> Frames;
+  static constexpr int VECTORS = Frames::VECTORS;
+
+  TQuadrature<float_4> quadrature[VECTORS];
+  // The dry signal, lined up with the FIR's real part
+  TMatchingDelay<float_4> dry[VECTORS];
+  TBiquadHPF<float_4> hpf[VECTORS];
+  TOnePoleLPF<float_4> post[VECTORS];
+
+  // One oscillator for both channels, which the lanes of the right channel
+  // turn by the stereo spread
+  P oscC = 1.0f, oscS = 0.0f;
+  float_4 laneCos[VECTORS], laneSin[VECTORS];
+  int stereo = STEREO_LINKED;
   int renormalizeCounter = 0;
 
-  float targetShift = 0.0f;
-  float targetWet = 0.0f;
-  float targetSignedShift = 0.0f;
+  P targetWet = 0.0f;
+  P targetSignedShift = 0.0f;
 
-  float currentWet = 0.0f;
-  float currentSignedShift = 0.0f;
+  P currentWet = 0.0f;
+  P currentSignedShift = 0.0f;
 
   float lastSampleRate = 0.0f;
-  int blockCounter = 0;
-  float cosD = 1.0f;
-  float sinD = 0.0f;
+  P cosD = 1.0f;
+  P sinD = 0.0f;
+  bool bypassed = false;
+
+  // Smoothing decay over 0 to CONTROL_FRAMES frames, per sample rate, and
+  // the mix gains at the end of the last control block
+  float wetDecay[CONTROL_FRAMES + 1];
+  float shiftDecay[CONTROL_FRAMES + 1];
+  P gainDry = 1.0f;
+  P gainWet = 0.0f;
 
 public:
+  // Smoothed wet amount and shift under which the wet path is inaudible,
+  // about -80 dB, and gets cut off
+  static constexpr float WET_EPSILON = 1e-4f;
+  static constexpr float SHIFT_EPSILON = 0.5f;
+  // How far ahead the right oscillator runs in STEREO_SPREAD
+  static constexpr float SPREAD_PHASE = 0.5f * M_PI;
+
+  TFrequencyShifter() { setStereo(STEREO_LINKED); }
+
   void setParams(float k1, float k2) {
+    float shift, wet, signedShift;
+    mapParams(k1, k2, shift, wet, signedShift);
+    targetWet = wet;
+    targetSignedShift = signedShift;
+  }
+  // The knobs of one lane, with P = float_4
+  void setParams(float k1, float k2, int i) {
+    float shift;
+    mapParams(k1, k2, shift, lane(targetWet, i), lane(targetSignedShift, i));
+  }
+
+  // One of TQuadrature::Mode, the FIR by default. Clears the shifter when
+  // the mode changes.
+  void setHilbert(int mode) {
+    if (mode == getHilbert())
+      return;
+    for (int k = 0; k < VECTORS; k++) {
+      quadrature[k].setMode(mode);
+      dry[k].reset();
+    }
+  }
+  int getHilbert() const { return quadrature[0].getMode(); }
+
+  // Samples the whole output of the next processBlock() lags the input by,
+  // dry and wet alike: 63 with the FIR, none with the IIR pair, and none
+  // while bypassed
+  int getLatency() const { return isIdle() ? 0 : quadrature[0].getLatency(); }
+
+  // One of Stereo. Spread turns the right channel's oscillator a quarter
+  // turn ahead, so the shifted copies of a mono input differ in phase.
+  void setStereo(int mode) {
+    stereo = rack::math::clamp(mode, 0, NUM_STEREO_MODES - 1);
+    float phase = 0.0f;
+    if (stereo == STEREO_SPREAD)
+      phase = SPREAD_PHASE;
+    for (int k = 0; k < VECTORS; k++) {
+      float_4 right = Frames::rightLanes(k);
+      laneCos[k] = 1.0f + right * (std::cos(phase) - 1.0f);
+      laneSin[k] = right * std::sin(phase);
+    }
+  }
+  int getStereo() const { return stereo; }
+
+  // Knob positions to the shift in Hz, the wet amount and the shift with
+  // the direction picked by the wet knob
+  static void mapParams(float k1, float k2, float &shift, float &wet,
+                        float &signedShift) {
     const float F_min = 50.0f;
     const float F_max = 5000.0f;
-    targetShift = F_min + (F_max - F_min) * std::pow(k1, 2.0f);
+    shift = F_min + (F_max - F_min) * std::pow(k1, 2.0f);
 
     float wetRaw = k2 * 2.0f - 1.0f;
     float detent = 0.04f;
     if (std::abs(wetRaw) < detent) {
-      targetWet = 0.0f;
-      targetSignedShift = 0.0f;
+      wet = 0.0f;
+      signedShift = 0.0f;
     } else {
-      targetWet = std::abs(wetRaw);
-      targetSignedShift = (wetRaw > 0.0f ? 1.0f : -1.0f) * targetShift;
+      wet = std::abs(wetRaw);
+      signedShift = (wetRaw > 0.0f ? 1.0f : -1.0f) * shift;
     }
   }
 
-  void process(float &left, float &right, float sampleRate) {
+  // One frame, as processBlock()
+  void process(T &left, T &right, float sampleRate) {
+    processBlock(&left, &right, 1, sampleRate);
+  }
+
+  // While the wet knob sits in the detent, once the wet amount and the shift
+  // have faded out, only the output clipper is left to run. The wet path is
+  // cleared then, so it fades back in from silence. The output isn't delayed
+  // then, but the dry delay is still fed, so it is current when the shifter
+  // comes back. With P = float_4 that waits for every lane.
+  void processBlock(T *left, T *right, int frames, float sampleRate) {
+    if (updateBypass()) {
+      bool aligned = quadrature[0].getLatency() > 0;
+      for (int i = 0; i < frames; i++) {
+        float_4 v[VECTORS];
+        Frames::pack(left[i], right[i], v);
+        for (int k = 0; k < VECTORS; k++) {
+          if (aligned)
+            dry[k].process(v[k]);
+          v[k] = sanitize(softClip(v[k]));
+        }
+        Frames::unpack(v, left[i], right[i]);
+      }
+      return;
+    }
     if (sampleRate < 1.0f)
       return;
 
     if (std::abs(sampleRate - lastSampleRate) > 1.0f) {
-      hpfL.setParams(40.0f, sampleRate);
-      hpfR.setParams(40.0f, sampleRate);
+      for (int k = 0; k < VECTORS; k++)
+        hpf[k].setParams(40.0f, sampleRate);
+      const float tauWet = 0.015f;
+      const float tauShift = 0.030f;
+      for (int n = 0; n <= CONTROL_FRAMES; n++) {
+        wetDecay[n] = std::exp(-(float)n / (tauWet * sampleRate));
+        shiftDecay[n] = std::exp(-(float)n / (tauShift * sampleRate));
+      }
       lastSampleRate = sampleRate;
     }
 
-    const float tauWet = 0.015f;
-    const float tauShift = 0.030f;
-    float lambdaWet = 1.0f - std::exp(-1.0f / (tauWet * sampleRate));
-    float lambdaShift = 1.0f - std::exp(-1.0f / (tauShift * sampleRate));
-
-    currentWet += (targetWet - currentWet) * lambdaWet;
-    currentSignedShift +=
-        (targetSignedShift - currentSignedShift) * lambdaShift;
+    for (int offset = 0; offset < frames; offset += CONTROL_FRAMES) {
+      int n = std::min((int)CONTROL_FRAMES, frames - offset);
+      processControlBlock(left + offset, right + offset, n, sampleRate);
+    }
+    flushDenormals();
+  }
 
-    if (--blockCounter <= 0) {
-      blockCounter = 16;
-      float delta = 2.0f * M_PI * currentSignedShift / sampleRate;
-      cosD = std::cos(delta);
-      sinD = std::sin(delta);
+  // Once per block, on the recursive filters, the only state that can decay
+  // into denormals
+  void flushDenormals() {
+    for (int k = 0; k < VECTORS; k++) {
+      quadrature[k].flushDenormals();
+      hpf[k].flushDenormals();
+      post[k].flushDenormals();
     }
+  }
+
+private:
+  // Lowpass after the shifter, closing as the shift grows
+  static P lowpassCoefficient(P signedShift) {
+    P k = 1.0f - (rack::simd::fabs(signedShift) / 5000.0f) * 0.8f;
+    return rack::simd::fmin(rack::simd::fmax(k, P(0.1f)), P(1.0f));
+  }
+
+  // One vector of input through the shifter, with the oscillator as the
+  // lanes see it
+  float_4 shiftVector(int k, float_4 in, float_4 c, float_4 s, bool aligned,
+                      P gDry, P gWet, P kLPF) {
+    float_4 filtered = hpf[k].process(in);
 
-    float absShift = std::abs(currentSignedShift);
-    float kLPF =
-        rack::math::clamp(1.0f - (absShift / 5000.0f) * 0.8f, 0.1f, 1.0f);
-
-    float *ch[2] = {&left, &right};
-    float *osc_c[2] = {&osc_cL, &osc_cR};
-    float *osc_s[2] = {&osc_sL, &osc_sR};
-
-    for (int i = 0; i < 2; ++i) {
-      float in_raw = *ch[i];
-      float in_filtered =
-          (i == 0) ? hpfL.process(in_raw) : hpfR.process(in_raw);
-
-      // Independent oscillator update per channel
-      float c = *osc_c[i];
-      float s = *osc_s[i];
-      float next_c = c * cosD - s * sinD;
-      float next_s = s * cosD + c * sinD;
-      *osc_c[i] = next_c;
-      *osc_s[i] = next_s;
-
-      // Real part (Match Delay) and Imag part (Hilbert FIR)
-      float x_re =
-          (i == 0) ? delayL.process(in_filtered) : delayR.process(in_filtered);
-      float x_im = (i == 0) ? hilbertL.process(in_filtered)
-                            : hilbertR.process(in_filtered);
-
-      // SSB Recombination (Warde/Weaver Correct)
-      // y = x_re * cos - x_im * sin
-      float shifted = x_re * next_c - x_im * next_s;
-
-      // Equal-power Mix
-      float theta = (M_PI * 0.5f) * currentWet;
-      float gDry = std::cos(theta);
-      float gWet = std::sin(theta);
-      float mixed = gDry * in_raw + gWet * shifted;
-
-      // Adaptive LPF and Soft Clipping for stability
-      float output =
-          (i == 0) ? postL.process(mixed, kLPF) : postR.process(mixed, kLPF);
-      float limit = 0.95f;
-      if (output > limit)
-        output = limit +
-                 (1.0f - limit) * std::tanh((output - limit) / (1.0f - limit));
-      else if (output < -limit)
-        output = -limit -
-                 (1.0f - limit) * std::tanh((-output - limit) / (1.0f - limit));
-
-      if (!std::isfinite(output))
-        output = 0.0f;
-      *ch[i] = output;
+    // Real part and Imag part, from the FIR or the IIR Hilbert
+    float_4 re, im;
+    quadrature[k].process(filtered, re, im);
+
+    // SSB Recombination (Warde/Weaver Correct)
+    // y = re * cos - im * sin
+    float_4 shifted = re * c - im * s;
+
+    // Equal-power Mix
+    float_4 mixed = gDry * (aligned ? dry[k].process(in) : in) + gWet * shifted;
+
+    // Adaptive LPF and Soft Clipping for stability
+    return sanitize(softClip(post[k].process(mixed, kLPF)));
+  }
+
+  // The smoothing, oscillator and mix gains run once per control block, up
+  // to CONTROL_FRAMES long. The gains and the lowpass ramp linearly to where
+  // the one-pole smoothing is at its end, and the oscillator turns at the
+  // shift halfway through.
+  void processControlBlock(T *left, T *right, int frames, float sampleRate) {
+    P wet = targetWet + (currentWet - targetWet) * wetDecay[frames];
+    P shift = targetSignedShift +
+              (currentSignedShift - targetSignedShift) * shiftDecay[frames];
+
+    P delta = (float)M_PI * (currentSignedShift + shift) / sampleRate;
+    cosD = rack::simd::cos(delta);
+    sinD = rack::simd::sin(delta);
+
+    P theta = ((float)M_PI * 0.5f) * wet;
+    P dryEnd = rack::simd::cos(theta);
+    P wetEnd = rack::simd::sin(theta);
+    P kStart = lowpassCoefficient(currentSignedShift);
+    P kEnd = lowpassCoefficient(shift);
+
+    bool aligned = quadrature[0].getLatency() > 0;
+    float step = 1.0f / (float)frames;
+    for (int i = 0; i < frames; i++) {
+      float t = (float)(i + 1) * step;
+      P gDry = gainDry + (dryEnd - gainDry) * t;
+      P gWet = gainWet + (wetEnd - gainWet) * t;
+      P kLPF = kStart + (kEnd - kStart) * t;
+
+      P c = oscC;
+      P s = oscS;
+      oscC = c * cosD - s * sinD;
+      oscS = s * cosD + c * sinD;
+
+      float_4 v[VECTORS];
+      Frames::pack(left[i], right[i], v);
+      for (int k = 0; k < VECTORS; k++) {
+        float_4 laneC = oscC * laneCos[k] - oscS * laneSin[k];
+        float_4 laneS = oscS * laneCos[k] + oscC * laneSin[k];
+        v[k] = shiftVector(k, v[k], laneC, laneS, aligned, gDry, gWet, kLPF);
+      }
+      Frames::unpack(v, left[i], right[i]);
     }
+    currentWet = wet;
+    currentSignedShift = shift;
+    gainDry = dryEnd;
+    gainWet = wetEnd;
 
-    if (++renormalizeCounter >= 512) {
+    renormalizeCounter += frames;
+    if (renormalizeCounter >= 512) {
       renormalizeCounter = 0;
-      float rL = 1.0f / std::sqrt(osc_cL * osc_cL + osc_sL * osc_sL);
-      osc_cL *= rL;
-      osc_sL *= rL;
-      float rR = 1.0f / std::sqrt(osc_cR * osc_cR + osc_sR * osc_sR);
-      osc_cR *= rR;
-      osc_sR *= rR;
+      P r = 1.0f / rack::simd::sqrt(oscC * oscC + oscS * oscS);
+      oscC *= r;
+      oscS *= r;
     }
   }
+
+  // Whether the next block is bypassed
+  bool isIdle() const {
+    return allZero(targetWet) && allZero(targetSignedShift) &&
+           allBelow(currentWet, WET_EPSILON) &&
+           allBelow(currentSignedShift, SHIFT_EPSILON);
+  }
+
+  bool updateBypass() {
+    bool idle = isIdle();
+    if (idle && !bypassed) {
+      currentWet = 0.0f;
+      currentSignedShift = 0.0f;
+      gainDry = 1.0f;
+      gainWet = 0.0f;
+      for (int k = 0; k < VECTORS; k++) {
+        quadrature[k].reset();
+        hpf[k].reset();
+        post[k].reset();
+      }
+    }
+    bypassed = idle;
+    return bypassed;
+  }
 };
 
+typedef TFrequencyShifter<float> FrequencyShifter;
+
 } // namespace paisa
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Denormals.hpp"
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
@@ -29,6 +30,8 @@ struct dsp {
 };
 
 #define FAUSTFLOAT float
+// Faust output (-single, scalar). The .dsp it was generated from isn't in
+// this tree, so other builds of it (-double, -vec) can't be made from here.
 #include "HoleReverb.hpp"
 
 namespace paisa {
@@ -43,7 +46,11 @@ public:
   float modFreq = 2.0f;
   // -------------------------------------
 
-  HoleReverb() { inner = new mydsp(); }
+  HoleReverb() {
+    inner = new mydsp();
+    // Sliders start at the DSP's defaults, which prepare() keeps
+    inner->instanceResetUserInterface();
+  }
 
   ~HoleReverb() { delete inner; }
 
@@ -73,30 +80,76 @@ public:
     inner->fHslider6 = size;
   }
 
-  void process(float &left, float &right, float sampleRate) {
-    if (std::abs(sampleRate - lastSampleRate) > 1.0f) {
-      inner->init((int)sampleRate);
-      lastSampleRate = sampleRate;
-    }
-
-    float *inputs[2] = {&left, &right};
-    float outL = 0.f, outR = 0.f;
-    float *outputs[2] = {&outL, &outR};
-
-    inner->compute(1, inputs, outputs);
+  // Sets the Faust code up for `sampleRate`, which clears all of its delay
+  // memory, several MB. Call it off the audio thread, before processing at
+  // a new rate. A reverb that was never prepared does it on its first block,
+  // one prepared for another rate only lets the dry part through.
+  void prepare(float sampleRate) {
+    // init() also puts the sliders back to their defaults
+    FAUSTFLOAT sliders[7] = {inner->fHslider0, inner->fHslider1,
+                             inner->fHslider2, inner->fHslider3,
+                             inner->fHslider4, inner->fHslider5,
+                             inner->fHslider6};
+    inner->init((int)sampleRate);
+    inner->fHslider0 = sliders[0];
+    inner->fHslider1 = sliders[1];
+    inner->fHslider2 = sliders[2];
+    inner->fHslider3 = sliders[3];
+    inner->fHslider4 = sliders[4];
+    inner->fHslider5 = sliders[5];
+    inner->fHslider6 = sliders[6];
+    lastSampleRate = sampleRate;
+  }
 
-    // Apply mix
-    left = left + (outL - left) * mix;
-    right = right + (outR - right) * mix;
+  void process(float &left, float &right, float sampleRate) {
+    processBlock(&left, &right, 1, sampleRate);
+  }
 
-    if (!std::isfinite(left))
-      left = 0.0f;
-    if (!std::isfinite(right))
-      right = 0.0f;
+  // Runs the Faust code over whole blocks, so the part it computes from the
+  // sliders is done once per block instead of once per frame, in place.
+  void processBlock(float *left, float *right, int frames, float sampleRate) {
+    if (lastSampleRate == 0.0f)
+      prepare(sampleRate);
+    if (sampleRate != lastSampleRate) {
+      // Waiting for a replacement prepared for this rate, since init() here
+      // would stall the audio thread
+      for (int i = 0; i < frames; i++) {
+        left[i] *= 1.f - mix;
+        right[i] *= 1.f - mix;
+      }
+      return;
+    }
+    // The Faust code was generated with -ftz 0, so its recursions count on
+    // the thread flushing denormals
+    paisa::ScopedFlushDenormals flushDenormals;
+
+    for (int offset = 0; offset < frames; offset += MAX_BLOCK) {
+      int n = std::min((int)MAX_BLOCK, frames - offset);
+      float *l = left + offset;
+      float *r = right + offset;
+      float *inputs[2] = {l, r};
+      float *outputs[2] = {wetL, wetR};
+      inner->compute(n, inputs, outputs);
+
+      // Apply mix
+      for (int i = 0; i < n; i++) {
+        l[i] = l[i] + (wetL[i] - l[i]) * mix;
+        r[i] = r[i] + (wetR[i] - r[i]) * mix;
+        if (!std::isfinite(l[i]))
+          l[i] = 0.0f;
+        if (!std::isfinite(r[i]))
+          r[i] = 0.0f;
+      }
+    }
   }
 
 private:
+  static constexpr int MAX_BLOCK = 64;
+
   mydsp *inner;
+  // Faust output, kept apart from the input it is mixed with
+  float wetL[MAX_BLOCK];
+  float wetR[MAX_BLOCK];
   float mix = 0.3f;
   float lastSampleRate = 0.0f;
 };
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+namespace paisa {
+
+/**
+ * Fractional delay kernels for DelayProcessor.
+ * A kernel reads POINTS consecutive interleaved stereo frames, oldest first.
+ * The frame at the integer part of the delay is LOOKAHEAD frames from the
+ * newest one, so a kernel with look-ahead needs that many frames of extra
+ * delay to stay causal.
+ * weights() runs once per block for the block's fractional delay, apply()
+ * once per frame, with no branches on the kernel type. Frames hold T, float or
+ * float_4, while the weights are shared by every lane.
+ */
+
+// Filter memory for the recursive kernels, unused by the FIR ones
+template <typename T> struct TInterpolationState {
+  T left = 0.f;
+  T right = 0.f;
+};
+
+typedef TInterpolationState<float> InterpolationState;
+
+template <int N, int L> struct FirInterpolator {
+  static constexpr int POINTS = N;
+  static constexpr int LOOKAHEAD = L;
+
+  template <typename T>
+  static void apply(const T *f, const float *w, TInterpolationState<T> &,
+                    T &left, T &right) {
+    T l = 0.f, r = 0.f;
+    for (int k = 0; k < N; k++) {
+      l += f[2 * k] * w[k];
+      r += f[2 * k + 1] * w[k];
+    }
+    left = l;
+    right = r;
+  }
+};
+
+// Two points, what the delay always used
+struct LinearInterpolator : FirInterpolator<2, 0> {
+  static void weights(float frac, float *w) {
+    w[0] = frac;
+    w[1] = 1.0f - frac;
+  }
+};
+
+// Third order Lagrange polynomial through four points
+struct Lagrange3Interpolator : FirInterpolator<4, 1> {
+  static void weights(float t, float *w) {
+    float tm1 = t - 1.0f;
+    float tm2 = t - 2.0f;
+    float tp1 = t + 1.0f;
+    w[0] = tp1 * t * tm1 * (1.0f / 6.0f);
+    w[1] = -tp1 * t * tm2 * 0.5f;
+    w[2] = tp1 * tm1 * tm2 * 0.5f;
+    w[3] = -t * tm1 * tm2 * (1.0f / 6.0f);
+  }
+};
+
+// Catmull-Rom cubic, smoother than Lagrange between the points
+struct HermiteInterpolator : FirInterpolator<4, 1> {
+  static void weights(float t, float *w) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    w[0] = 0.5f * (t3 - t2);
+    w[1] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    w[2] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    w[3] = 0.5f * (-t3 + 2.0f * t2 - t);
+  }
+};
+
+/**
+ * First order allpass, flat magnitude at every fractional delay.
+ * It is recursive, so it is only right when every frame is read once and in
+ * order, as the taps do. The fraction is taken in [1, 2) behind the newest
+ * point, which keeps the pole within 1/3 of the origin.
+ */
+struct AllpassInterpolator {
+  static constexpr int POINTS = 2;
+  static constexpr int LOOKAHEAD = 1;
+
+  static void weights(float frac, float *w) { w[0] = -frac / (2.0f + frac); }
+
+  template <typename T>
+  static void apply(const T *f, const float *w, TInterpolationState<T> &state,
+                    T &left, T &right) {
+    float a = w[0];
+    state.left = a * (f[2] - state.left) + f[0];
+    state.right = a * (f[3] - state.right) + f[1];
+    left = state.left;
+    right = state.right;
+  }
+};
+
+/**
+ * Eight point Blackman windowed sinc. The impulse response is tabulated for
+ * PHASES fractional positions and blended linearly between neighbouring
+ * phases.
+ */
+struct SincInterpolator : FirInterpolator<8, 3> {
+  static constexpr int PHASES = 256;
+
+  struct Table {
+    float rows[PHASES + 1][POINTS];
+
+    Table() {
+      const double pi = 3.14159265358979323846;
+      const double half = POINTS / 2;
+      for (int p = 0; p <= PHASES; p++) {
+        double t = (double)p / PHASES;
+        double sum = 0.0;
+        double h[POINTS];
+        for (int k = 0; k < POINTS; k++) {
+          double x = k - half + t;
+          double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+          double window = 0.42 + 0.5 * std::cos(pi * x / half) +
+                          0.08 * std::cos(2.0 * pi * x / half);
+          h[k] = sinc * window;
+          sum += h[k];
+        }
+        // Unity gain at DC for every phase
+        for (int k = 0; k < POINTS; k++)
+          rows[p][k] = (float)(h[k] / sum);
+      }
+    }
+  };
+
+  static const Table &table() {
+    static const Table t;
+    return t;
+  }
+
+  static void weights(float frac, float *w) {
+    float x = frac * PHASES;
+    int i = std::min((int)x, PHASES - 1);
+    float mu = x - (float)i;
+    const float *a = table().rows[i];
+    const float *b = table().rows[i + 1];
+    for (int k = 0; k < POINTS; k++)
+      w[k] = a[k] + mu * (b[k] - a[k]);
+  }
+};
+
+} // namespace paisa
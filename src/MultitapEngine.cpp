@@ -0,0 +1,644 @@
+#include "MultitapEngine.hpp"
+#include "FDNReverb.hpp"
+#include "HoleReverbWrapper.hpp"
+#include "Multitap_delay.hpp"
+#include "Reverb.hpp"
+#include <chrono>
+
+namespace paisa {
+
+static_assert(MultitapEngine::NUM_MODES == Multitap_delay::NUM_MODES,
+              "a Params row holds the knobs of every mode");
+static_assert(MultitapEngine::Params::NUM_FIELDS <= 64,
+              "every Params field needs a bit in the change mask");
+
+typedef MultitapEngine::Params Params;
+
+// Fields every reverb reads, and the ones only the default reverb reads
+static const uint64_t SHARED_REVERB_FIELDS =
+    Params::bit(Params::REVERB_MIX) | Params::bit(Params::REVERB_GRAVITY) |
+    Params::bit(Params::REVERB_DIFFUSION);
+static const uint64_t DEFAULT_REVERB_FIELDS =
+    SHARED_REVERB_FIELDS | Params::bit(Params::REVERB_DAMPING) |
+    Params::bit(Params::REVERB_MOD_FREQ) |
+    Params::bit(Params::REVERB_MOD_DEPTH) | Params::bit(Params::REVERB_TIME);
+
+class DefaultReverbUnit : public MultitapEngine::ReverbUnit {
+  Reverb reverb;
+  float modFreq = 1.f; // Mapped rate, only recomputed when its knob moves
+
+public:
+  void setParams(const Params &p, uint64_t changed) override {
+    if (!(changed & DEFAULT_REVERB_FIELDS))
+      return;
+    if (changed & Params::bit(Params::REVERB_MOD_FREQ)) {
+      modFreq = std::exp(std::log(0.1f) +
+                         p.reverbModFreq * (std::log(10.0f) - std::log(0.1f)));
+    }
+    reverb.setParams(rack::math::clamp(p.reverbMix, 0.f, 1.f),
+                     rack::math::clamp(p.reverbGravity, 0.f, 1.f),
+                     rack::math::clamp(p.reverbDiffusion, 0.f, 1.f),
+                     rack::math::clamp(p.reverbDamping, 0.f, 1.f), modFreq,
+                     p.reverbModDepth * 2.0f, 0.25f + p.reverbTime * 2.0f);
+  }
+  void process(float *left, float *right, int frames,
+               float sampleRate) override {
+    for (int i = 0; i < frames; i++)
+      reverb.process(left[i], right[i], sampleRate);
+    reverb.flushDenormals();
+  }
+};
+
+// FDNReverb or HoleReverb, which take mix, gravity and diffusion
+template <typename R> class ReverbUnitOf : public MultitapEngine::ReverbUnit {
+protected:
+  R reverb;
+  float mix = 0.3f;
+
+public:
+  void setParams(const Params &p, uint64_t changed) override {
+    if (!(changed & SHARED_REVERB_FIELDS))
+      return;
+    mix = rack::math::clamp(p.reverbMix, 0.f, 1.f);
+    reverb.setParams(mix, rack::math::clamp(p.reverbGravity, 0.f, 1.f),
+                     rack::math::clamp(p.reverbDiffusion, 0.f, 1.f));
+  }
+  void process(float *left, float *right, int frames,
+               float sampleRate) override {
+    for (int i = 0; i < frames; i++)
+      reverb.process(left[i], right[i], sampleRate);
+  }
+};
+
+// Unlike the others, the Hole reverb fades the dry signal out as mix rises
+class HoleReverbUnit : public ReverbUnitOf<HoleReverb> {
+public:
+  void prepare(float sampleRate) override { reverb.prepare(sampleRate); }
+  void process(float *left, float *right, int frames,
+               float sampleRate) override {
+    reverb.processBlock(left, right, frames, sampleRate);
+  }
+  float getDryGain() const override { return 1.f - mix; }
+};
+
+MultitapEngine::ReverbUnit *MultitapEngine::makeReverb(int mode,
+                                                     float sampleRate) {
+  ReverbUnit *unit;
+  switch (mode) {
+  case REVERB_FDN:
+    unit = new ReverbUnitOf<FDNReverb>();
+    break;
+  case REVERB_HOLE:
+    unit = new HoleReverbUnit();
+    break;
+  default:
+    unit = new DefaultReverbUnit();
+    break;
+  }
+  unit->prepare(sampleRate);
+  return unit;
+}
+
+template <typename T> MultitapEngine::TapGroup<T>::TapGroup() {
+  for (int i = 0; i < NUM_TAPS; i++) {
+    taps.push_back(std::unique_ptr<TTap<T>>(new TTap<T>(MAX_DELAY_SAMPLES)));
+  }
+  clear();
+}
+
+template <typename T>
+void MultitapEngine::TapGroup<T>::reserve(const size_t *frames,
+                                          size_t longest, int mode) {
+  if (mode == SHARED_LINE) {
+    sharedLine.reserve(longest);
+  } else {
+    for (int t = 0; t < NUM_TAPS; t++)
+      taps[t]->reserveFrames(frames[t]);
+  }
+}
+
+template <typename T> void MultitapEngine::TapGroup<T>::clear() {
+  std::fill(inL, inL + MAX_BLOCK_SIZE, T(0.f));
+  std::fill(inR, inR + MAX_BLOCK_SIZE, T(0.f));
+  for (int t = 0; t < NUM_TAPS; t++) {
+    std::fill(tapL[t], tapL[t] + MAX_BLOCK_SIZE, T(0.f));
+    std::fill(tapR[t], tapR[t] + MAX_BLOCK_SIZE, T(0.f));
+  }
+}
+
+template <typename T>
+void MultitapEngine::TapGroup<T>::process(int frames, float sampleRate,
+                                          int lineMode,
+                                          const float *timeModulation) {
+  for (int t = 0; t < NUM_TAPS; t++)
+    taps[t]->setTimeModulation(timeModulation[t]);
+
+  if (lineMode == SHARED_LINE) {
+    processShared(frames, sampleRate);
+  } else {
+    for (int t = 0; t < NUM_TAPS; t++) {
+      taps[t]->processBlock(inL, inR, tapL[t], tapR[t], frames, sampleRate);
+    }
+  }
+}
+
+template <typename T>
+void MultitapEngine::TapGroup<T>::processShared(int frames, float sampleRate) {
+  sharedLine.commit();
+  int offset = 0;
+  while (offset < frames) {
+    // Same causality limit as Tap::processBlock, set by the shortest head
+    int n = frames - offset;
+    for (auto &tap : taps)
+      n = std::min(n, tap->getCausalFrames(sharedLine, sampleRate));
+
+    float feedback[NUM_TAPS];
+    for (int t = 0; t < NUM_TAPS; t++) {
+      taps[t]->processBlockShared(sharedLine, tapL[t] + offset,
+                                  tapR[t] + offset, n, sampleRate);
+      feedback[t] = taps[t]->getFeedbackAmount();
+    }
+
+    for (int i = offset; i < offset + n; i++) {
+      T l = inL[i];
+      T r = inR[i];
+      for (int t = 0; t < NUM_TAPS; t++) {
+        l += tapL[t][i] * feedback[t];
+        r += tapR[t][i] * feedback[t];
+      }
+      sharedLine.write(flushDenormal(l), flushDenormal(r));
+    }
+    offset += n;
+  }
+}
+
+MultitapEngine::Params::Params() {
+  for (int t = 0; t < NUM_TAPS; t++) {
+    taps[t][Multitap_delay::MODE_DELAY][0] = 0.05f + t * 0.05f;
+    taps[t][Multitap_delay::MODE_DELAY][1] = 0.0f;
+    taps[t][Multitap_delay::MODE_AMP_PAN][0] = 0.5f;
+    taps[t][Multitap_delay::MODE_AMP_PAN][1] = 0.5f;
+    taps[t][Multitap_delay::MODE_FILTER][0] = 0.5f;
+    taps[t][Multitap_delay::MODE_FILTER][1] = 1.0f;
+    taps[t][Multitap_delay::MODE_FX1][0] = 0.2f;
+    taps[t][Multitap_delay::MODE_FX1][1] = 0.5f;
+    taps[t][Multitap_delay::MODE_FX2][0] = 0.5f;
+    taps[t][Multitap_delay::MODE_FX2][1] = 0.5f;
+  }
+}
+
+uint64_t MultitapEngine::Params::diff(const Params &other) const {
+  uint64_t mask = 0;
+  for (int t = 0; t < NUM_TAPS; t++) {
+    for (int m = 0; m < NUM_MODES; m++) {
+      for (int k = 0; k < 2; k++) {
+        if (taps[t][m][k] != other.taps[t][m][k])
+          mask |= knobBit(t, m, k);
+      }
+    }
+  }
+  const float Params::*fields[] = {
+      &Params::phaserNoise,    &Params::reverbMix,
+      &Params::reverbGravity,  &Params::reverbDiffusion,
+      &Params::reverbDamping,  &Params::reverbModFreq,
+      &Params::reverbModDepth, &Params::reverbTime};
+  for (int f = PHASER_NOISE; f < NUM_FIELDS; f++) {
+    if (this->*fields[f - PHASER_NOISE] != other.*fields[f - PHASER_NOISE])
+      mask |= bit(f);
+  }
+  return mask;
+}
+
+MultitapEngine::MultitapEngine(int reverbMode, float sampleRate)
+    : reverb(makeReverb(reverbMode, sampleRate)), reverbMode(reverbMode),
+      reverbSampleRate(sampleRate) {
+  apply(published, ~(uint64_t)0);
+}
+
+MultitapEngine::~MultitapEngine() {
+  delete incomingReverb.load();
+  delete retiredReverb.load();
+}
+
+MultitapEngine::CrossfadeStats MultitapEngine::getCrossfadeStats() const {
+  CrossfadeStats stats;
+  stats.crossfades = crossfades.load(std::memory_order_relaxed);
+  stats.frames = crossfadeFrames.load(std::memory_order_relaxed);
+  stats.nanoseconds = crossfadeNanoseconds.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MultitapEngine::setReverbMode(int mode) {
+  std::lock_guard<std::mutex> lock(uiMutex);
+  delete retiredReverb.exchange(nullptr, std::memory_order_acquire);
+  if (mode == reverbMode)
+    return;
+  reverbMode = mode;
+  sendReverb();
+}
+
+void MultitapEngine::setSampleRate(float sampleRate) {
+  std::lock_guard<std::mutex> lock(uiMutex);
+  if (sampleRate == reverbSampleRate)
+    return;
+  reverbSampleRate = sampleRate;
+  sendReverb();
+}
+
+void MultitapEngine::sendReverb() {
+  ReverbUnit *unit = makeReverb(reverbMode, reverbSampleRate);
+  unit->setParams(published, ~(uint64_t)0);
+  // Replaces one the audio thread hasn't picked up yet
+  delete incomingReverb.exchange(unit, std::memory_order_acq_rel);
+}
+
+void MultitapEngine::publish(const Params &p) {
+  std::lock_guard<std::mutex> lock(uiMutex);
+  uint64_t changed = p.diff(published);
+  if (!changed)
+    return;
+  published = p;
+  params.write() = p;
+  params.publish();
+  // After the snapshot, so the consumer never sees bits without it
+  pending.fetch_or(changed, std::memory_order_release);
+}
+
+void MultitapEngine::reserve(float sampleRate, int mode) {
+  std::lock_guard<std::mutex> lock(uiMutex);
+  size_t frames[NUM_TAPS];
+  size_t longest = 0;
+  for (int t = 0; t < NUM_TAPS; t++) {
+    float time =
+        modulated[t] ? 1.f : published.taps[t][Multitap_delay::MODE_DELAY][0];
+    frames[t] = DelayProcessor::requiredFrames(time, sampleRate);
+    longest = std::max(longest, frames[t]);
+  }
+
+  if (mode == SHARED_LINE) {
+    mono.sharedLine.reserve(longest);
+  } else {
+    for (int t = 0; t < NUM_TAPS; t++)
+      mono.bank.reserve(t, frames[t]);
+  }
+  if (channels.load() > 1) {
+    for (int g = 0; g < getGroups(); g++)
+      poly[g].reserve(frames, longest, mode);
+  }
+}
+
+void MultitapEngine::apply(const Params &p, uint64_t changed) {
+  for (int t = 0; t < NUM_TAPS; t++) {
+    for (int m = 0; m < NUM_MODES; m++) {
+      uint64_t bits = Params::knobBit(t, m, 0) | Params::knobBit(t, m, 1);
+      if (m == Multitap_delay::MODE_FX2) {
+        if (changed & (bits | Params::bit(Params::PHASER_NOISE)))
+          setFX2Params(t, p.taps[t][m][0], p.taps[t][m][1], p.phaserNoise);
+      } else if (changed & bits) {
+        setParam(t, m, p.taps[t][m][0], p.taps[t][m][1]);
+      }
+    }
+  }
+  reverb->setParams(p, changed);
+  if (fadingReverb)
+    fadingReverb->setParams(p, changed);
+}
+
+void MultitapEngine::setParam(int tap, int mode, float p1, float p2) {
+  mono.bank.setParam(tap, mode, p1, p2);
+  for (auto &group : poly)
+    group.taps[tap]->setParam(mode, p1, p2);
+}
+
+void MultitapEngine::setFX2Params(int tap, float p1, float p2, float p3) {
+  mono.bank.setFX2Params(tap, p1, p2, p3);
+  for (auto &group : poly)
+    group.taps[tap]->setFX2Params(p1, p2, p3);
+}
+
+void MultitapEngine::setInterpolation(int mode) {
+  interpolation = mode;
+  mono.bank.setInterpolation(mode);
+  for (auto &group : poly) {
+    for (auto &tap : group.taps)
+      tap->setInterpolation(mode);
+  }
+}
+
+void MultitapEngine::setHilbert(int mode) {
+  hilbert = mode;
+  mono.bank.setHilbert(mode);
+  for (auto &group : poly) {
+    for (auto &tap : group.taps)
+      tap->setHilbert(mode);
+  }
+}
+
+void MultitapEngine::setShifterStereo(int mode) {
+  shifterStereo = mode;
+  mono.bank.setShifterStereo(mode);
+  for (auto &group : poly) {
+    for (auto &tap : group.taps)
+      tap->setShifterStereo(mode);
+  }
+}
+
+void MultitapEngine::setGlide(int mode, float seconds) {
+  glide = mode;
+  glideTime = seconds;
+  mono.bank.setGlide(mode, seconds);
+  for (auto &group : poly) {
+    for (auto &tap : group.taps)
+      tap->setGlide(mode, seconds);
+  }
+}
+
+void MultitapEngine::setBlockSize(int frames) {
+  blockSize = std::max(1, std::min((int)MAX_BLOCK_SIZE, frames));
+  clearBuffers();
+}
+
+void MultitapEngine::setChannels(int count) {
+  channels.store(std::max(1, std::min((int)MAX_CHANNELS, count)));
+  clearBuffers();
+}
+
+void MultitapEngine::clearBuffers() {
+  position = 0;
+  // Frames still queued for the old layout are dropped
+  std::fill(sumBufL, sumBufL + MAX_BLOCK_SIZE, 0.f);
+  std::fill(sumBufR, sumBufR + MAX_BLOCK_SIZE, 0.f);
+  std::fill(mono.inL, mono.inL + MAX_BLOCK_SIZE, 0.f);
+  std::fill(mono.inR, mono.inR + MAX_BLOCK_SIZE, 0.f);
+  std::fill(mono.tapL, mono.tapL + MAX_BLOCK_SIZE, float_4(0.f));
+  std::fill(mono.tapR, mono.tapR + MAX_BLOCK_SIZE, float_4(0.f));
+  for (auto &group : poly)
+    group.clear();
+}
+
+void MultitapEngine::process(const float *inL, const float *inR,
+                             float sampleRate, Frame &out) {
+  if (sleeping) {
+    // New knobs can make sound on their own, e.g. the phaser noise, so they
+    // wake the engine up like the input does
+    bool wake = !sleepEnabled || pending.load(std::memory_order_relaxed);
+    int count = channels.load();
+    for (int c = 0; c < count && !wake; c++) {
+      wake = std::fabs(inL[c]) >= SILENCE_THRESHOLD ||
+             std::fabs(inR[c]) >= SILENCE_THRESHOLD;
+    }
+    if (!wake) {
+      // The buffers were cleared when going to sleep
+      readFrame(position, out);
+      return;
+    }
+    sleeping = false;
+  }
+
+  if (blockSize <= 1) {
+    writeFrame(0, inL, inR);
+    processBlock(1, sampleRate);
+    readFrame(0, out);
+    return;
+  }
+
+  // The output slot still holds the frame computed one block ago
+  readFrame(position, out);
+  writeFrame(position, inL, inR);
+  if (++position >= blockSize) {
+    processBlock(blockSize, sampleRate);
+    position = 0;
+  }
+}
+
+void MultitapEngine::processBlock(int frames, float sampleRate) {
+  // Before the knobs, so a new reverb also gets changes published after it
+  // was built
+  swapReverb();
+  if (pending.load(std::memory_order_relaxed)) {
+    uint64_t changed = pending.exchange(0, std::memory_order_acquire);
+    // The bits can come with a snapshot taken by an earlier update(), in
+    // which case read() still has it
+    params.update();
+    apply(params.read(), changed);
+    // The tails of the new settings start over
+    quietFrames = 0;
+  }
+
+  int count = channels.load();
+  if (count <= 1) {
+    for (int t = 0; t < NUM_TAPS; t++)
+      mono.bank.setTimeModulation(t, timeModulation[t]);
+    if (lineMode == SHARED_LINE) {
+      mono.bank.processBlockShared(mono.sharedLine, mono.inL, mono.inR,
+                                   mono.tapL, mono.tapR, frames, sampleRate);
+    } else {
+      mono.bank.processBlock(mono.inL, mono.inR, mono.tapL, mono.tapR,
+                             frames, sampleRate);
+    }
+    for (int i = 0; i < frames; i++) {
+      float sumL = 0.f, sumR = 0.f;
+      for (int t = 0; t < NUM_TAPS; t++) {
+        sumL += mono.tapL[i][t];
+        sumR += mono.tapR[i][t];
+      }
+      sumBufL[i] = sumL * 0.25f;
+      sumBufR[i] = sumR * 0.25f;
+    }
+  } else {
+    // Every voice gets the same tap mix as the mono path, and the voices
+    // are then summed into the one stereo reverb
+    std::fill(sumBufL, sumBufL + frames, 0.f);
+    std::fill(sumBufR, sumBufR + frames, 0.f);
+    for (int g = 0; g < getGroups(); g++) {
+      TapGroup<float_4> &group = poly[g];
+      group.process(frames, sampleRate, lineMode, timeModulation);
+      int lanes = std::min(4, count - g * 4);
+      for (int i = 0; i < frames; i++) {
+        float_4 sumL = 0.f, sumR = 0.f;
+        for (int t = 0; t < NUM_TAPS; t++) {
+          sumL += group.tapL[t][i];
+          sumR += group.tapR[t][i];
+        }
+        for (int c = 0; c < lanes; c++) {
+          sumBufL[i] += sumL[c] * 0.25f;
+          sumBufR[i] += sumR[c] * 0.25f;
+        }
+      }
+    }
+  }
+
+  processReverb(frames, sampleRate);
+  updateSleep(frames, sampleRate);
+}
+
+void MultitapEngine::updateSleep(int frames, float sampleRate) {
+  // A crossfade runs to its end first
+  if (!sleepEnabled || fadingReverb || !isSilent(frames)) {
+    quietFrames = 0;
+    return;
+  }
+  quietFrames += frames;
+  // Whatever the lines hold was written while everything was silent, so
+  // nothing above the threshold can come out of them any more
+  if (quietFrames < longestDelay(sampleRate) +
+                        (size_t)(SLEEP_HOLD_TIME * sampleRate))
+    return;
+  sleeping = true;
+  quietFrames = 0;
+  // The silent frames still queued in the output become exact zeros
+  clearBuffers();
+}
+
+bool MultitapEngine::isSilent(int frames) const {
+  // Peak of the float_4 buffers per lane, and of the float ones
+  float_4 peak = 0.f;
+  float monoPeak = 0.f;
+  int count = channels.load();
+  if (count <= 1) {
+    for (int i = 0; i < frames; i++) {
+      peak = rack::simd::fmax(peak, rack::simd::fabs(mono.tapL[i]));
+      peak = rack::simd::fmax(peak, rack::simd::fabs(mono.tapR[i]));
+      monoPeak = std::max(monoPeak, std::fabs(mono.inL[i]));
+      monoPeak = std::max(monoPeak, std::fabs(mono.inR[i]));
+    }
+  } else {
+    for (int g = 0; g < getGroups(); g++) {
+      const TapGroup<float_4> &group = poly[g];
+      for (int i = 0; i < frames; i++) {
+        peak = rack::simd::fmax(peak, rack::simd::fabs(group.inL[i]));
+        peak = rack::simd::fmax(peak, rack::simd::fabs(group.inR[i]));
+        for (int t = 0; t < NUM_TAPS; t++) {
+          peak = rack::simd::fmax(peak, rack::simd::fabs(group.tapL[t][i]));
+          peak = rack::simd::fmax(peak, rack::simd::fabs(group.tapR[t][i]));
+        }
+      }
+    }
+  }
+  for (int i = 0; i < frames; i++) {
+    monoPeak = std::max(monoPeak, std::fabs(sumBufL[i]));
+    monoPeak = std::max(monoPeak, std::fabs(sumBufR[i]));
+  }
+  for (int c = 0; c < 4; c++)
+    monoPeak = std::max(monoPeak, peak[c]);
+  return monoPeak < SILENCE_THRESHOLD;
+}
+
+size_t MultitapEngine::longestDelay(float sampleRate) const {
+  const Params &p = params.read();
+  size_t longest = 0;
+  for (int t = 0; t < NUM_TAPS; t++) {
+    // A modulated tap can reach the longest time
+    float knob = timeModulation[t] != 0.f
+                     ? 1.f
+                     : p.taps[t][Multitap_delay::MODE_DELAY][0];
+    longest =
+        std::max(longest, DelayProcessor::requiredFrames(knob, sampleRate));
+  }
+  return longest;
+}
+
+void MultitapEngine::swapReverb() {
+  if (fadingReverb && reverbFade >= 1.f) {
+    // Parked until the UI side has freed the previous one
+    ReverbUnit *expected = nullptr;
+    if (retiredReverb.compare_exchange_strong(expected, fadingReverb.get(),
+                                              std::memory_order_release)) {
+      fadingReverb.release();
+      reverbRetired = true;
+    }
+  }
+  if (fadingReverb)
+    return;
+  ReverbUnit *next =
+      incomingReverb.exchange(nullptr, std::memory_order_acquire);
+  if (next) {
+    fadingReverb = std::move(reverb);
+    reverb.reset(next);
+    reverbFade = 0.f;
+    crossfades.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void MultitapEngine::processReverb(int frames, float sampleRate) {
+  if (!fadingReverb || reverbFade >= 1.f) {
+    reverb->process(sumBufL, sumBufR, frames, sampleRate);
+    return;
+  }
+
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start = clock::now();
+  // Both run on the same dry sum
+  std::copy(sumBufL, sumBufL + frames, dryBufL);
+  std::copy(sumBufR, sumBufR + frames, dryBufR);
+  std::copy(sumBufL, sumBufL + frames, fadeBufL);
+  std::copy(sumBufR, sumBufR + frames, fadeBufR);
+  fadingReverb->process(fadeBufL, fadeBufR, frames, sampleRate);
+  clock::time_point outgoingDone = clock::now();
+  reverb->process(sumBufL, sumBufR, frames, sampleRate);
+  clock::time_point mixStart = clock::now();
+
+  // The two reverb tails don't correlate, so they get equal power gains.
+  // The dry signal they both carry moves linearly from one's dry gain to
+  // the other's, so it keeps its level.
+  float oldDry = fadingReverb->getDryGain();
+  float newDry = reverb->getDryGain();
+  float step = 1.f / std::max(1.f, reverbFadeTime * sampleRate);
+  for (int i = 0; i < frames; i++) {
+    float x = std::min(1.f, reverbFade + step * (float)(i + 1));
+    float gOld = std::cos(x * (float)M_PI * 0.5f);
+    float gNew = std::sin(x * (float)M_PI * 0.5f);
+    float dry = oldDry + (newDry - oldDry) * x;
+    sumBufL[i] = dryBufL[i] * dry + (fadeBufL[i] - dryBufL[i] * oldDry) * gOld +
+                 (sumBufL[i] - dryBufL[i] * newDry) * gNew;
+    sumBufR[i] = dryBufR[i] * dry + (fadeBufR[i] - dryBufR[i] * oldDry) * gOld +
+                 (sumBufR[i] - dryBufR[i] * newDry) * gNew;
+  }
+  reverbFade = std::min(1.f, reverbFade + step * (float)frames);
+
+  clock::duration extra = (outgoingDone - start) + (clock::now() - mixStart);
+  crossfadeFrames.fetch_add(frames, std::memory_order_relaxed);
+  crossfadeNanoseconds.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(extra).count(),
+      std::memory_order_relaxed);
+}
+
+void MultitapEngine::writeFrame(int index, const float *inL,
+                                const float *inR) {
+  int count = channels.load();
+  if (count <= 1) {
+    mono.inL[index] = inL[0];
+    mono.inR[index] = inR[0];
+    return;
+  }
+  for (int g = 0; g < getGroups(); g++) {
+    float_4 l = 0.f, r = 0.f;
+    for (int c = 0; c < 4 && g * 4 + c < count; c++) {
+      l[c] = inL[g * 4 + c];
+      r[c] = inR[g * 4 + c];
+    }
+    poly[g].inL[index] = l;
+    poly[g].inR[index] = r;
+  }
+}
+
+void MultitapEngine::readFrame(int index, Frame &out) const {
+  int count = channels.load();
+  if (count <= 1) {
+    for (int t = 0; t < NUM_TAPS; t++) {
+      out.tapL[t][0] = mono.tapL[index][t];
+      out.tapR[t][0] = mono.tapR[index][t];
+    }
+  } else {
+    for (int t = 0; t < NUM_TAPS; t++) {
+      for (int c = 0; c < count; c++) {
+        out.tapL[t][c] = poly[c / 4].tapL[t][index][c % 4];
+        out.tapR[t][c] = poly[c / 4].tapR[t][index][c % 4];
+      }
+    }
+  }
+  out.sumL = sumBufL[index];
+  out.sumR = sumBufR[index];
+}
+
+} // namespace paisa
@@ -0,0 +1,334 @@
+#pragma once
+#include "Tap.hpp"
+#include "TapBank.hpp"
+#include "TripleBuffer.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace paisa {
+
+/**
+ * Block-based DSP core of the Multitap module.
+ * Frames coming from the host's per-sample callback are accumulated into
+ * blocks, and every stage then runs over a whole contiguous block at once.
+ * This adds a fixed latency of one block. A block size of 1 processes each
+ * frame as it arrives, with no added latency.
+ * A single channel runs on plain floats. Polyphonic input runs the taps on
+ * float_4, four voices per group, and the voices are mixed into the reverb.
+ * Knob settings come from the UI thread as whole Params snapshots, handed
+ * over without locks and applied at the next block boundary.
+ * The methods marked UI side may be called from any thread but the audio
+ * one, and lock each other out.
+ * Only the selected reverb exists. Switching it, or the sample rate, builds
+ * a new one in setReverbMode(), the audio thread runs both through an equal
+ * power crossfade, and then parks the old one for the next call to free.
+ * Once the input and every tail have been silent for longer than the
+ * longest delay, the engine sleeps: it outputs exact zeros without running
+ * any stage, until an input frame or a knob change wakes it up.
+ */
+class MultitapEngine {
+public:
+  static constexpr int NUM_TAPS = 4;
+  static constexpr int MAX_BLOCK_SIZE = 64;
+  static constexpr size_t MAX_DELAY_SAMPLES = 192000 * 10;
+  static constexpr int MAX_CHANNELS = 16;
+  static constexpr int MAX_GROUPS = MAX_CHANNELS / 4;
+  static constexpr int NUM_MODES = 5; // One per Multitap_delay::Mode
+  // Peak under which a signal counts as silent, -120 dB below Rack's 10 V
+  static constexpr float SILENCE_THRESHOLD = 1e-5f;
+  // Silence needed on top of the longest delay before sleeping, in seconds,
+  // for the reverb and the tap processors to ring out
+  static constexpr float SLEEP_HOLD_TIME = 1.f;
+
+  enum LineMode {
+    // Every tap owns a delay line and feeds its own output back into it
+    INDEPENDENT_LINES,
+    // One line written once per frame, the taps are read heads on it and
+    // their feedback is summed into the shared write
+    SHARED_LINE,
+    NUM_LINE_MODES
+  };
+
+  /** One output frame: every tap per channel plus the reverberated sum. */
+  struct Frame {
+    float tapL[NUM_TAPS][MAX_CHANNELS];
+    float tapR[NUM_TAPS][MAX_CHANNELS];
+    float sumL;
+    float sumR;
+  };
+
+  /** Every knob the taps and reverbs read, in [0, 1]. */
+  struct Params {
+    // [Tap][Multitap_delay::Mode][Knob]
+    float taps[NUM_TAPS][NUM_MODES][2];
+    float phaserNoise = 0.f;
+    float reverbMix = 0.3f;
+    float reverbGravity = 0.5f;
+    float reverbDiffusion = 0.5f;
+    float reverbDamping = 0.2f;
+    float reverbModFreq = 0.5f;
+    float reverbModDepth = 0.5f;
+    float reverbTime = 0.5f;
+
+    // Bits of a change mask: one per tap knob, then one per other field
+    static constexpr int KNOB_BITS = NUM_TAPS * NUM_MODES * 2;
+    enum Field {
+      PHASER_NOISE = KNOB_BITS,
+      REVERB_MIX,
+      REVERB_GRAVITY,
+      REVERB_DIFFUSION,
+      REVERB_DAMPING,
+      REVERB_MOD_FREQ,
+      REVERB_MOD_DEPTH,
+      REVERB_TIME,
+      NUM_FIELDS
+    };
+    static uint64_t bit(int field) { return (uint64_t)1 << field; }
+    static uint64_t knobBit(int tap, int mode, int knob) {
+      return bit((tap * NUM_MODES + mode) * 2 + knob);
+    }
+
+    // Same settings as a freshly added module
+    Params();
+    // Mask of what differs from `other`
+    uint64_t diff(const Params &other) const;
+  };
+
+  enum ReverbMode { REVERB_DEFAULT, REVERB_FDN, REVERB_HOLE, NUM_REVERBS };
+
+  /** One of the reverbs, processing whole blocks in place. */
+  struct ReverbUnit {
+    virtual ~ReverbUnit() {}
+    // Sets up any state that depends on the sample rate. Called before the
+    // unit reaches the audio thread.
+    virtual void prepare(float sampleRate) {}
+    // Takes the reverb fields of `p` flagged in `changed`
+    virtual void setParams(const Params &p, uint64_t changed) = 0;
+    // Dry sum in, mixed signal out
+    virtual void process(float *left, float *right, int frames,
+                         float sampleRate) = 0;
+    // How much of the dry input the output carries
+    virtual float getDryGain() const { return 1.f; }
+  };
+
+  /** Extra work done while two reverbs run through a crossfade. */
+  struct CrossfadeStats {
+    uint64_t crossfades;  // Started so far
+    uint64_t frames;      // Frames that ran through both reverbs
+    uint64_t nanoseconds; // Spent on the outgoing reverb and the mix
+  };
+
+  MultitapEngine(int reverbMode = REVERB_DEFAULT, float sampleRate = 48000.f);
+  ~MultitapEngine();
+
+  // Hands a new set of knobs to the audio thread, which picks it up at the
+  // start of its next block and only updates the processors whose knobs
+  // changed. UI side, and never blocks the audio thread.
+  void publish(const Params &params);
+
+  // Sizes the delay lines used by `mode` for the published delay times at
+  // `sampleRate`, for the current number of channels. Allocates, UI side.
+  void reserve(float sampleRate, int mode);
+
+  // Builds the reverb for `mode` if it isn't the current one, and frees the
+  // one the audio thread has faded out of. UI side, called again after
+  // takeRetiredReverb() so the old reverb doesn't linger.
+  void setReverbMode(int mode);
+  int getReverbMode() const { return reverbMode; }
+  // Whether a faded-out reverb was parked for the UI side to free since the
+  // last call. Audio thread.
+  bool takeRetiredReverb() {
+    bool parked = reverbRetired;
+    reverbRetired = false;
+    return parked;
+  }
+
+  // Replaces the reverb with one prepared for `sampleRate`, so nothing is
+  // rebuilt on the audio thread when process() gets the new rate. A Hole
+  // reverb for the old rate only passes its dry part until then. UI side,
+  // like setReverbMode().
+  void setSampleRate(float sampleRate);
+
+  // Length of the crossfade into a new reverb. Audio thread, like the other
+  // engine settings.
+  void setReverbFadeTime(float seconds) {
+    reverbFadeTime = std::max(0.f, seconds);
+  }
+  float getReverbFadeTime() const { return reverbFadeTime; }
+  // Readable from any thread
+  CrossfadeStats getCrossfadeStats() const;
+
+  // Whether a tap's delay time is modulated, in which case its line is sized
+  // for the longest time. UI side, followed by reserve().
+  void setModulated(int tap, bool on) {
+    std::lock_guard<std::mutex> lock(uiMutex);
+    modulated[tap] = on;
+  }
+
+  void setLineMode(int mode) { lineMode = mode; }
+  int getLineMode() const { return lineMode; }
+
+  // One of DelayProcessor::Interpolation, for every tap
+  void setInterpolation(int mode);
+  int getInterpolation() const { return interpolation; }
+
+  // One of TQuadrature::Mode, for the frequency shifter of every tap. The
+  // FIR's latency is taken off the delay times while a shifter is active.
+  void setHilbert(int mode);
+  int getHilbert() const { return hilbert; }
+
+  // One of TFrequencyShifter::Stereo, for the frequency shifter of every tap
+  void setShifterStereo(int mode);
+  int getShifterStereo() const { return shifterStereo; }
+
+  // One of DelayProcessor::Glide, and its time in seconds
+  void setGlide(int mode, float seconds);
+  int getGlide() const { return glide; }
+  float getGlideTime() const { return glideTime; }
+
+  // Delay time offset of a tap in knob units, picked up once per block
+  void setTimeModulation(int tap, float amount) {
+    timeModulation[tap] = amount;
+  }
+
+  void setBlockSize(int frames);
+  int getBlockSize() const { return blockSize; }
+  // Latency in frames added by the block accumulation
+  int getLatency() const { return blockSize > 1 ? blockSize : 0; }
+
+  // Whether the engine may sleep once everything is silent, on by default.
+  // Audio thread.
+  void setSleepEnabled(bool on) {
+    sleepEnabled = on;
+    quietFrames = 0;
+  }
+  bool getSleepEnabled() const { return sleepEnabled; }
+  bool isSleeping() const { return sleeping; }
+
+  // Number of voices, 1 to MAX_CHANNELS. Voices added here stay silent
+  // until reserve() has sized their delay lines.
+  void setChannels(int count);
+  int getChannels() const { return channels.load(); }
+
+  // Pushes one input frame of getChannels() voices and returns the output
+  // frame that is due now.
+  void process(const float *inL, const float *inR, float sampleRate,
+               Frame &out);
+  // Shorthand while getChannels() is 1
+  void process(float inL, float inR, float sampleRate, Frame &out) {
+    process(&inL, &inR, sampleRate, out);
+  }
+
+private:
+  /**
+   * The four taps for four polyphonic voices, with their block buffers.
+   */
+  template <typename T> struct TapGroup {
+    std::vector<std::unique_ptr<TTap<T>>> taps;
+    TDelayLine<T> sharedLine{MAX_DELAY_SAMPLES};
+
+    T inL[MAX_BLOCK_SIZE];
+    T inR[MAX_BLOCK_SIZE];
+    T tapL[NUM_TAPS][MAX_BLOCK_SIZE];
+    T tapR[NUM_TAPS][MAX_BLOCK_SIZE];
+
+    TapGroup();
+    // Per tap frames, or the longest of them for the shared line
+    void reserve(const size_t *frames, size_t longest, int mode);
+    void clear();
+    void process(int frames, float sampleRate, int lineMode,
+                 const float *timeModulation);
+    void processShared(int frames, float sampleRate);
+  };
+
+  // A single voice runs on the bank, where lane t of tapL/tapR is tap t
+  struct MonoGroup {
+    TapBank bank{MAX_DELAY_SAMPLES};
+    DelayLine sharedLine{MAX_DELAY_SAMPLES};
+    float inL[MAX_BLOCK_SIZE];
+    float inR[MAX_BLOCK_SIZE];
+    float_4 tapL[MAX_BLOCK_SIZE];
+    float_4 tapR[MAX_BLOCK_SIZE];
+  };
+
+  MonoGroup mono;
+  TapGroup<float_4> poly[MAX_GROUPS];
+
+  TripleBuffer<Params> params;
+  // Fields changed since the audio thread last applied a snapshot. Kept
+  // apart from the snapshots, since the consumer can skip some of them.
+  std::atomic<uint64_t> pending{0};
+  // UI side copies, what reserve() sizes the lines from
+  Params published;
+  bool modulated[NUM_TAPS] = {};
+  // Held by the UI side methods, never by the audio thread
+  std::mutex uiMutex;
+  std::atomic<int> channels{1};
+
+  int lineMode = INDEPENDENT_LINES;
+  int interpolation = DelayProcessor::INTERP_LINEAR;
+  int hilbert = TQuadrature<float>::HILBERT_FIR;
+  int shifterStereo = FrequencyShifter::STEREO_LINKED;
+  int glide = DelayProcessor::GLIDE_TAPE;
+  float glideTime = 0.1f;
+  float timeModulation[NUM_TAPS] = {};
+
+  int blockSize = 32;
+  int position = 0;
+
+  bool sleepEnabled = true;
+  bool sleeping = false;
+  // Consecutive frames in which the input and all outputs were silent
+  size_t quietFrames = 0;
+
+  float sumBufL[MAX_BLOCK_SIZE] = {};
+  float sumBufR[MAX_BLOCK_SIZE] = {};
+
+  int getGroups() const { return (channels.load() + 3) / 4; }
+  // The selected reverb, and the one it replaces. The old one is parked,
+  // no longer processed, once the fade is over.
+  std::unique_ptr<ReverbUnit> reverb;
+  std::unique_ptr<ReverbUnit> fadingReverb;
+  float reverbFade = 1.f; // Position in the crossfade, 1 once it is over
+  float reverbFadeTime = 0.05f;
+  float dryBufL[MAX_BLOCK_SIZE];
+  float dryBufR[MAX_BLOCK_SIZE];
+  float fadeBufL[MAX_BLOCK_SIZE];
+  float fadeBufR[MAX_BLOCK_SIZE];
+  std::atomic<uint64_t> crossfades{0};
+  std::atomic<uint64_t> crossfadeFrames{0};
+  std::atomic<uint64_t> crossfadeNanoseconds{0};
+  // New reverbs come from the UI side, and old ones go back to be freed
+  std::atomic<ReverbUnit *> incomingReverb{nullptr};
+  std::atomic<ReverbUnit *> retiredReverb{nullptr};
+  // Audio side, set when a reverb was parked in retiredReverb
+  bool reverbRetired = false;
+  // UI side, what the last reverb built was for
+  int reverbMode;
+  float reverbSampleRate;
+
+  static ReverbUnit *makeReverb(int mode, float sampleRate);
+  void sendReverb();
+
+  // Audio side: pushes the `changed` fields of a snapshot into the taps and
+  // reverbs
+  void apply(const Params &p, uint64_t changed);
+  void setParam(int tap, int mode, float p1, float p2);
+  void setFX2Params(int tap, float p1, float p2, float p3);
+  void swapReverb();
+  void processReverb(int frames, float sampleRate);
+  void clearBuffers();
+  void processBlock(int frames, float sampleRate);
+  // Counts the silent frames of the block just processed, and goes to sleep
+  // once the tails must be gone
+  void updateSleep(int frames, float sampleRate);
+  bool isSilent(int frames) const;
+  // Frames a tail can take to come out of the longest delay
+  size_t longestDelay(float sampleRate) const;
+  void writeFrame(int index, const float *inL, const float *inR);
+  void readFrame(int index, Frame &out) const;
+};
+
+} // namespace paisa
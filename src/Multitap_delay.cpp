@@ -5,6 +5,27 @@
 // Speed for the relative encoders
 float ENCODER_SENSITIVITY = 0.0015f;
 
+// Block sizes the context menu offers
+static const std::vector<int> BLOCK_SIZES = {1, 16, 32, 64};
+
+// Glide times in seconds the context menu offers
+static const std::vector<float> GLIDE_TIMES = {0.f, 0.02f, 0.1f, 0.5f, 2.f};
+
+// Reverb switch crossfades in seconds the context menu offers
+static const std::vector<float> REVERB_FADE_TIMES = {0.01f, 0.05f, 0.2f, 1.f};
+
+// The option closest to `value`, so a setting loaded from a patch is always
+// one the menu can show and the engine accepts as is
+template <typename V>
+static V snapToOption(const std::vector<V> &options, V value) {
+  V best = options[0];
+  for (V option : options) {
+    if (std::fabs((float)(option - value)) < std::fabs((float)(best - value)))
+      best = option;
+  }
+  return best;
+}
+
 struct RelativeKnob : RoundBlackKnob {
   int col = 0;
   int k = 0; // 0 for Knob 1, 1 for Knob 2
@@ -176,22 +197,23 @@ Multitap_delay::Multitap_delay() {
 
   configInput(IN_L_INPUT, "Left Input");
   configInput(IN_R_INPUT, "Right Input");
-
   for (int i = 0; i < 4; i++) {
-    configOutput(OUT1_L_OUTPUT + i * 2, string::f("Tap %d Left", i + 1));
-    configOutput(OUT1_R_OUTPUT + i * 2, string::f("Tap %d Right", i + 1));
+    configInput(TIME_CV_INPUTS + i, string::f("Tap %d Delay Time CV", i + 1))
+        ->description = "1V moves the delay time knob by a tenth. Only "
+                        "channel 1 is read, for every voice";
   }
-  configOutput(SUM_L_OUTPUT, "Sum Left");
-  configOutput(SUM_R_OUTPUT, "Sum Right");
 
   for (int i = 0; i < 4; i++) {
-    taps.push_back(
-        std::unique_ptr<paisa::Tap>(new paisa::Tap(MAX_DELAY_SAMPLES)));
+    configOutput(OUT1_L_OUTPUT + i * 2, string::f("Tap %d Left", i + 1));
+    configOutput(OUT1_R_OUTPUT + i * 2, string::f("Tap %d Right", i + 1));
   }
+  configOutput(SUM_L_OUTPUT, "Sum Left")->description =
+      "Mono: each voice's taps mixed, then every voice added up unscaled";
+  configOutput(SUM_R_OUTPUT, "Sum Right")->description =
+      "Mono: each voice's taps mixed, then every voice added up unscaled";
 
-  reverb = std::unique_ptr<paisa::Reverb>(new paisa::Reverb());
-  fdnReverb = std::unique_ptr<paisa::FDNReverb>(new paisa::FDNReverb());
-  holeReverb = std::unique_ptr<paisa::HoleReverb>(new paisa::HoleReverb());
+  engine.setBlockSize(blockSize);
+  engine.setGlide(glide, glideTime);
 
   for (int col = 0; col < 5; col++) {
     for (int m = 0; m < 5; m++) {
@@ -213,36 +235,74 @@ Multitap_delay::Multitap_delay() {
         knobState[col][m][0] = 0.5f; // ~1.4 Hz
         knobState[col][m][1] = 0.5f; // 50% depth
       }
-
-      if (col < 4) {
-        taps[col]->setParam(m, knobState[col][m][0], knobState[col][m][1]);
-      }
     }
   }
   updateKnobsFromState();
+  worker = std::thread(&Multitap_delay::runWorker, this);
+}
+
+Multitap_delay::~Multitap_delay() {
+  {
+    std::lock_guard<std::mutex> lock(workerMutex);
+    workerStop = true;
+  }
+  workerWake.notify_one();
+  worker.join();
+}
+
+void Multitap_delay::runWorker() {
+  std::unique_lock<std::mutex> lock(workerMutex);
+  while (true) {
+    workerWake.wait(lock, [this] { return workerQueued || workerStop; });
+    if (workerStop)
+      return;
+    workerQueued = false;
+    // Wakes that come in meanwhile queue another pass
+    lock.unlock();
+    // New voices, or a new rate, need delay memory, which can't be
+    // allocated in process()
+    if (reservePending.exchange(false))
+      engine.reserve(sampleRate, lineMode);
+    engine.setSampleRate(sampleRate);
+    // Builds the reverb the knob asks for, and frees the one switched away
+    // from once the audio thread has faded out of it
+    engine.setReverbMode(reverbMode);
+    lock.lock();
+  }
 }
 
-Multitap_delay::~Multitap_delay() {}
+void Multitap_delay::wakeWorker() {
+  {
+    std::lock_guard<std::mutex> lock(workerMutex);
+    workerQueued = true;
+  }
+  workerWake.notify_one();
+}
+
+void Multitap_delay::tryWakeWorker() {
+  // The worker only holds its mutex between passes, so a miss is retried on
+  // the next frame
+  if (!workerMutex.try_lock()) {
+    workerWakePending = true;
+    return;
+  }
+  workerQueued = true;
+  workerMutex.unlock();
+  workerWake.notify_one();
+  workerWakePending = false;
+}
 
 void Multitap_delay::updateKnobsFromState() {
+  updateKnobDisplay();
+  publishParams();
+}
+
+void Multitap_delay::updateKnobDisplay() {
   for (int i = 0; i < 5; i++) {
     params[COL_KNOB1_PARAMS + i].setValue(
         math::clamp(knobState[i][currentMode][0], 0.f, 1.f));
     params[COL_KNOB2_PARAMS + i].setValue(
         math::clamp(knobState[i][currentMode][1], 0.f, 1.f));
-
-    if (i < 4) {
-      for (int m = 0; m < NUM_MODES; m++) {
-        float p1 = knobState[i][m][0];
-        float p2 = knobState[i][m][1];
-        if (m == MODE_FX2) {
-          // Special case for FX2 to include noise gain from state
-          taps[i]->setFX2Params(p1, p2, phaserNoiseGainState);
-        } else {
-          taps[i]->setParam(m, p1, p2);
-        }
-      }
-    }
   }
   params[INPUT_GAIN_PARAM].setValue(math::clamp(inputGainState, 0.f, 1.f));
   params[REVERB_MIX_PARAM].setValue(math::clamp(reverbMixState, 0.f, 1.f));
@@ -250,29 +310,6 @@ void Multitap_delay::updateKnobsFromState() {
       math::clamp(reverbGravityState, 0.f, 1.f));
   params[REVERB_DIFFUSION_PARAM].setValue(
       math::clamp(reverbDiffusionState, 0.f, 1.f));
-
-  if (reverb) {
-    float modF =
-        std::exp(std::log(0.1f) +
-                 reverbModFreqState * (std::log(10.0f) - std::log(0.1f)));
-    float modD = reverbModDepthState * 2.0f;
-    float tScale = 0.25f + reverbTimeState * 2.0f;
-    reverb->setParams(math::clamp(reverbMixState, 0.f, 1.f),
-                      math::clamp(reverbGravityState, 0.f, 1.f),
-                      math::clamp(reverbDiffusionState, 0.f, 1.f),
-                      math::clamp(reverbDampingState, 0.f, 1.f), modF, modD,
-                      tScale);
-  }
-  if (fdnReverb) {
-    fdnReverb->setParams(math::clamp(reverbMixState, 0.f, 1.f),
-                         math::clamp(reverbGravityState, 0.f, 1.f),
-                         math::clamp(reverbDiffusionState, 0.f, 1.f));
-  }
-  if (holeReverb) {
-    holeReverb->setParams(math::clamp(reverbMixState, 0.f, 1.f),
-                          math::clamp(reverbGravityState, 0.f, 1.f),
-                          math::clamp(reverbDiffusionState, 0.f, 1.f));
-  }
   params[REVERB_DAMPING_PARAM].setValue(
       math::clamp(reverbDampingState, 0.f, 1.f));
   params[REVERB_MOD_FREQ_PARAM].setValue(
@@ -284,25 +321,85 @@ void Multitap_delay::updateKnobsFromState() {
       math::clamp(phaserNoiseGainState, 0.f, 1.f));
 }
 
-void Multitap_delay::onSampleRateChange() {}
+void Multitap_delay::publishParams() {
+  paisa::MultitapEngine::Params p;
+  for (int i = 0; i < 4; i++) {
+    for (int m = 0; m < NUM_MODES; m++) {
+      p.taps[i][m][0] = knobState[i][m][0];
+      p.taps[i][m][1] = knobState[i][m][1];
+    }
+  }
+  p.phaserNoise = phaserNoiseGainState;
+  p.reverbMix = reverbMixState;
+  p.reverbGravity = reverbGravityState;
+  p.reverbDiffusion = reverbDiffusionState;
+  p.reverbDamping = reverbDampingState;
+  p.reverbModFreq = reverbModFreqState;
+  p.reverbModDepth = reverbModDepthState;
+  p.reverbTime = reverbTimeState;
+  engine.publish(p);
+  // Delay memory follows the longest delay dialed in. dataFromJson() gets
+  // here with Rack's engine locked, so the worker allocates it.
+  reservePending = true;
+  wakeWorker();
+}
+
+void Multitap_delay::onSampleRateChange(const SampleRateChangeEvent &e) {
+  // Rack calls this with its engine locked, so the worker sizes the delay
+  // memory and builds a reverb for the new rate. The tap processors only
+  // recompute coefficients, once per block.
+  sampleRate = e.sampleRate;
+  reservePending = true;
+  wakeWorker();
+}
+
+void Multitap_delay::onPortChange(const PortChangeEvent &e) {
+  if (e.type != engine::Port::INPUT || e.portId < TIME_CV_INPUTS ||
+      e.portId >= TIME_CV_INPUTS + 4)
+    return;
+  // Rack calls this with its engine locked, so the worker grows the line
+  // for the modulation range
+  engine.setModulated(e.portId - TIME_CV_INPUTS, e.connecting);
+  reservePending = true;
+  wakeWorker();
+}
 
 void Multitap_delay::process(const ProcessArgs &args) {
-  float inL = inputs[IN_L_INPUT].getVoltage();
-  float inR =
-      inputs[IN_R_INPUT].isConnected() ? inputs[IN_R_INPUT].getVoltage() : inL;
+  // Decaying tails must not fall into denormals, whatever mode the host
+  // runs this thread in
+  paisa::ScopedFlushDenormals flushDenormals;
+
+  // One voice per input channel, a mono right input follows the left one
+  int channels = std::max(1, std::max(inputs[IN_L_INPUT].getChannels(),
+                                      inputs[IN_R_INPUT].getChannels()));
+  if (channels != engine.getChannels()) {
+    engine.setChannels(channels);
+    reservePending = true;
+    workerWakePending = true;
+  }
 
   float kIn = math::clamp(inputGainState, 0.f, 1.f);
   float gainInDb = kIn * 78.f - 72.f;
   float gainIn = std::pow(10.f, gainInDb / 20.f);
-  inL *= gainIn;
-  inR *= gainIn;
+
+  float inL[paisa::MultitapEngine::MAX_CHANNELS];
+  float inR[paisa::MultitapEngine::MAX_CHANNELS];
+  for (int c = 0; c < channels; c++) {
+    inL[c] = inputs[IN_L_INPUT].getPolyVoltage(c);
+    inR[c] = inputs[IN_R_INPUT].isConnected()
+                 ? inputs[IN_R_INPUT].getPolyVoltage(c)
+                 : inL[c];
+    inL[c] *= gainIn;
+    inR[c] *= gainIn;
+  }
 
   for (int m = 0; m < 5; m++) {
     if (params[MODE_PARAMS + m].getValue() > 0.5f) {
       if (currentMode != m) {
         params[MODE_PARAMS + currentMode].setValue(0.f);
         currentMode = m;
-        updateKnobsFromState();
+        // Only the knobs shown change, the engine already has every mode
+        updateKnobDisplay();
       }
     }
   }
@@ -310,33 +407,48 @@ void Multitap_delay::process(const ProcessArgs &args) {
     params[MODE_PARAMS + currentMode].setValue(1.f);
   }
 
-  reverbMode = (int)std::round(params[REVERB_MODE_PARAM].getValue());
-
-  float sumL = 0.f, sumR = 0.f;
-  for (int i = 0; i < 4; i++) {
-    float tapL, tapR;
-    taps[i]->process(inL, inR, tapL, tapR, args.sampleRate);
-    outputs[OUT1_L_OUTPUT + i * 2].setVoltage(tapL);
-    outputs[OUT1_R_OUTPUT + i * 2].setVoltage(tapR);
-    sumL += tapL;
-    sumR += tapR;
+  // Picked up by the worker, which builds the reverb off the audio thread
+  int mode = (int)std::round(params[REVERB_MODE_PARAM].getValue());
+  if (mode != reverbMode) {
+    reverbMode = mode;
+    workerWakePending = true;
   }
+  if (blockSize != engine.getBlockSize())
+    engine.setBlockSize(blockSize);
+  if (lineMode != engine.getLineMode())
+    engine.setLineMode(lineMode);
+  if (interpolation != engine.getInterpolation())
+    engine.setInterpolation(interpolation);
+  if (hilbert != engine.getHilbert())
+    engine.setHilbert(hilbert);
+  if (shifterStereo != engine.getShifterStereo())
+    engine.setShifterStereo(shifterStereo);
+  if (glide != engine.getGlide() || glideTime != engine.getGlideTime())
+    engine.setGlide(glide, glideTime);
+  if (reverbFadeTime != engine.getReverbFadeTime())
+    engine.setReverbFadeTime(reverbFadeTime);
+
+  for (int i = 0; i < 4; i++)
+    engine.setTimeModulation(i, inputs[TIME_CV_INPUTS + i].getVoltage() * 0.1f);
+
+  paisa::MultitapEngine::Frame frame;
+  engine.process(inL, inR, args.sampleRate, frame);
+  // A reverb faded out of goes back to the worker to be freed
+  if (engine.takeRetiredReverb())
+    workerWakePending = true;
+  if (workerWakePending)
+    tryWakeWorker();
 
-  float outL = sumL * 0.25f;
-  float outR = sumR * 0.25f;
-  if (reverbMode == 1) {
-    if (fdnReverb)
-      fdnReverb->process(outL, outR, args.sampleRate);
-  } else if (reverbMode == 2) {
-    if (holeReverb)
-      holeReverb->process(outL, outR, args.sampleRate);
-  } else {
-    if (reverb)
-      reverb->process(outL, outR, args.sampleRate);
+  for (int i = 0; i < 4; i++) {
+    outputs[OUT1_L_OUTPUT + i * 2].setChannels(channels);
+    outputs[OUT1_R_OUTPUT + i * 2].setChannels(channels);
+    for (int c = 0; c < channels; c++) {
+      outputs[OUT1_L_OUTPUT + i * 2].setVoltage(frame.tapL[i][c], c);
+      outputs[OUT1_R_OUTPUT + i * 2].setVoltage(frame.tapR[i][c], c);
+    }
   }
-
-  outputs[SUM_L_OUTPUT].setVoltage(outL);
-  outputs[SUM_R_OUTPUT].setVoltage(outR);
+  outputs[SUM_L_OUTPUT].setVoltage(frame.sumL);
+  outputs[SUM_R_OUTPUT].setVoltage(frame.sumR);
 
   for (int m = 0; m < 5; m++) {
     lights[MODE_LIGHTS + m].setBrightness(currentMode == m ? 1.f : 0.f);
@@ -370,6 +482,14 @@ json_t *Multitap_delay::dataToJson() {
   json_object_set_new(rootJ, "phaserNoiseGainState",
                       json_real(phaserNoiseGainState));
   json_object_set_new(rootJ, "currentMode", json_integer(currentMode));
+  json_object_set_new(rootJ, "blockSize", json_integer(blockSize));
+  json_object_set_new(rootJ, "lineMode", json_integer(lineMode));
+  json_object_set_new(rootJ, "interpolation", json_integer(interpolation));
+  json_object_set_new(rootJ, "hilbert", json_integer(hilbert));
+  json_object_set_new(rootJ, "shifterStereo", json_integer(shifterStereo));
+  json_object_set_new(rootJ, "glide", json_integer(glide));
+  json_object_set_new(rootJ, "glideTime", json_real(glideTime));
+  json_object_set_new(rootJ, "reverbFadeTime", json_real(reverbFadeTime));
   return rootJ;
 }
 
@@ -428,6 +548,38 @@ void Multitap_delay::dataFromJson(json_t *rootJ) {
   json_t *modeJ = json_object_get(rootJ, "currentMode");
   if (modeJ)
     currentMode = json_integer_value(modeJ);
+  json_t *blockSizeJ = json_object_get(rootJ, "blockSize");
+  if (blockSizeJ)
+    blockSize = snapToOption(BLOCK_SIZES, (int)json_integer_value(blockSizeJ));
+  json_t *lineModeJ = json_object_get(rootJ, "lineMode");
+  if (lineModeJ)
+    lineMode = math::clamp((int)json_integer_value(lineModeJ), 0,
+                           paisa::MultitapEngine::NUM_LINE_MODES - 1);
+  json_t *interpolationJ = json_object_get(rootJ, "interpolation");
+  if (interpolationJ)
+    interpolation = math::clamp((int)json_integer_value(interpolationJ), 0,
+                                paisa::DelayProcessor::NUM_INTERPOLATIONS - 1);
+  json_t *hilbertJ = json_object_get(rootJ, "hilbert");
+  if (hilbertJ)
+    hilbert = math::clamp((int)json_integer_value(hilbertJ), 0,
+                          paisa::TQuadrature<float>::NUM_HILBERT_MODES - 1);
+  json_t *shifterStereoJ = json_object_get(rootJ, "shifterStereo");
+  if (shifterStereoJ)
+    shifterStereo = math::clamp((int)json_integer_value(shifterStereoJ), 0,
+                                paisa::FrequencyShifter::NUM_STEREO_MODES - 1);
+  json_t *glideJ = json_object_get(rootJ, "glide");
+  if (glideJ)
+    glide = math::clamp((int)json_integer_value(glideJ), 0,
+                        paisa::DelayProcessor::NUM_GLIDES - 1);
+  json_t *glideTimeJ = json_object_get(rootJ, "glideTime");
+  if (glideTimeJ)
+    glideTime = snapToOption(GLIDE_TIMES, (float)json_real_value(glideTimeJ));
+  json_t *reverbFadeTimeJ = json_object_get(rootJ, "reverbFadeTime");
+  if (reverbFadeTimeJ)
+    reverbFadeTime = snapToOption(REVERB_FADE_TIMES,
+                                  (float)json_real_value(reverbFadeTimeJ));
+  // Also wakes the worker, which builds the loaded reverb at the rate Rack
+  // reports rather than here with its engine locked
   updateKnobsFromState();
 }
 
@@ -610,6 +762,19 @@ struct Multitap_delayWidget : ModuleWidget {
     sn->type = AdvancedSlider::PH_NOISE;
     addParam(sn);
 
+    // Delay time CV, one per tap
+    Label *cvLabel = new Label();
+    cvLabel->box.pos = mm2px(Vec(startX - 2.0, 92));
+    cvLabel->fontSize = 8;
+    cvLabel->color = nvgRGB(0xff, 0xff, 0xff);
+    cvLabel->text = "TIME CV";
+    addChild(cvLabel);
+    for (int i = 0; i < 4; i++) {
+      addInput(createInputCentered<ThemedPJ301MPort>(
+          mm2px(Vec(startX + 5.0 + i * 12.0, 105)), module,
+          Multitap_delay::TIME_CV_INPUTS + i));
+    }
+
     Label *advLabel = new Label();
     advLabel->box.pos = mm2px(Vec(startX - 2.0, 15));
     advLabel->fontSize = 10;
@@ -658,6 +823,74 @@ struct Multitap_delayWidget : ModuleWidget {
     ModuleWidget::step();
   }
 
+  void appendContextMenu(Menu *menu) override {
+    auto *module = dynamic_cast<Multitap_delay *>(this->module);
+    assert(module);
+
+    menu->addChild(new MenuSeparator);
+
+    menu->addChild(createIndexSubmenuItem(
+        "Processing block",
+        {"Off (zero latency)", "16 samples", "32 samples", "64 samples"},
+        [=]() {
+          auto it = std::find(BLOCK_SIZES.begin(), BLOCK_SIZES.end(),
+                              module->blockSize);
+          return std::distance(BLOCK_SIZES.begin(), it);
+        },
+        [=](int i) { module->blockSize = BLOCK_SIZES[i]; }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Delay lines", {"Independent (feedback per tap)", "Shared (multitap)"},
+        [=]() { return module->lineMode.load(); },
+        [=](int i) {
+          // Size the new topology before the audio thread switches to it
+          module->engine.reserve(module->sampleRate, i);
+          module->lineMode = i;
+        }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Delay interpolation",
+        {"Linear", "Lagrange (3rd order)", "Hermite", "Allpass",
+         "Windowed sinc (8 points)"},
+        [=]() { return module->interpolation; },
+        [=](int i) { module->interpolation = i; }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Frequency shifter",
+        {"Linear phase (FIR, latency compensated)", "Low latency (IIR)"},
+        [=]() { return module->hilbert; },
+        [=](int i) { module->hilbert = i; }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Frequency shifter stereo",
+        {"Linked", "Spread (right oscillator a quarter turn ahead)"},
+        [=]() { return module->shifterStereo; },
+        [=](int i) { module->shifterStereo = i; }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Delay time glide", {"Tape (pitch bend)", "Crossfade"},
+        [=]() { return module->glide; },
+        [=](int i) { module->glide = i; }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Glide time", {"Off (jump)", "20 ms", "100 ms", "500 ms", "2 s"},
+        [=]() {
+          auto it = std::find(GLIDE_TIMES.begin(), GLIDE_TIMES.end(),
+                              module->glideTime);
+          return std::distance(GLIDE_TIMES.begin(), it);
+        },
+        [=](int i) { module->glideTime = GLIDE_TIMES[i]; }));
+
+    menu->addChild(createIndexSubmenuItem(
+        "Reverb switch crossfade", {"10 ms", "50 ms", "200 ms", "1 s"},
+        [=]() {
+          auto it = std::find(REVERB_FADE_TIMES.begin(),
+                              REVERB_FADE_TIMES.end(), module->reverbFadeTime);
+          return std::distance(REVERB_FADE_TIMES.begin(), it);
+        },
+        [=](int i) { module->reverbFadeTime = REVERB_FADE_TIMES[i]; }));
+  }
+
   std::string formatValue(int mode, int k, float val) {
     std::stringstream ss;
     ss << std::fixed << std::setprecision(1);
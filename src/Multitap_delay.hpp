@@ -1,9 +1,9 @@
 #pragma once
-#include "FDNReverb.hpp"
-#include "HoleReverbWrapper.hpp"
-#include "Reverb.hpp"
-#include "Tap.hpp"
+#include "MultitapEngine.hpp"
 #include "plugin.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 struct Multitap_delay : Module {
   enum ParamId {
@@ -23,7 +23,12 @@ struct Multitap_delay : Module {
     PHASER_NOISE_GAIN_PARAM,
     NUM_PARAMS
   };
-  enum InputId { IN_L_INPUT, IN_R_INPUT, NUM_INPUTS };
+  enum InputId {
+    IN_L_INPUT,
+    IN_R_INPUT,
+    ENUMS(TIME_CV_INPUTS, 4), // Delay time per tap, 10V spans the knob
+    NUM_INPUTS
+  };
   enum OutputId {
     OUT1_L_OUTPUT,
     OUT1_R_OUTPUT,
@@ -67,22 +72,50 @@ struct Multitap_delay : Module {
 
   int currentMode = 0;
 
-  static constexpr size_t MAX_DELAY_SAMPLES = 192000 * 10;
+  paisa::MultitapEngine engine;
 
-  std::vector<std::unique_ptr<paisa::Tap>> taps;
-  std::unique_ptr<paisa::Reverb> reverb;
-  std::unique_ptr<paisa::FDNReverb> fdnReverb;
-  std::unique_ptr<paisa::HoleReverb> holeReverb;
+  std::atomic<int> reverbMode{0}; // 0 for Default, 1 for FDN, 2 for Hole
+  int blockSize = 32; // 1 processes every sample with no added latency
+  std::atomic<int> lineMode{paisa::MultitapEngine::INDEPENDENT_LINES};
+  int interpolation = paisa::DelayProcessor::INTERP_LINEAR;
+  // Frequency shifter transformer, the FIR for patches saved without one
+  int hilbert = paisa::TQuadrature<float>::HILBERT_FIR;
+  int shifterStereo = paisa::FrequencyShifter::STEREO_LINKED;
+  int glide = paisa::DelayProcessor::GLIDE_TAPE;
+  float glideTime = 0.1f; // Seconds, 0 jumps straight to the new time
+  float reverbFadeTime = 0.05f; // Seconds of crossfade into a new reverb
+  std::atomic<float> sampleRate{48000.f}; // Last rate reported by Rack
+  // Set when the delay times, the voice count, the rate or the time CV
+  // patching changed, so the worker sizes the delay lines
+  std::atomic<bool> reservePending{false};
 
-  int reverbMode = 0; // 0 for Default, 1 for FDN, 2 for Hole
+  // Does the engine's allocations away from the audio thread, whether or
+  // not a widget is open. It sleeps until something queues work.
+  std::thread worker;
+  std::mutex workerMutex;
+  std::condition_variable workerWake;
+  bool workerQueued = false;
+  bool workerStop = false;
+  // Audio side, a wake the worker hasn't been given yet
+  bool workerWakePending = false;
 
   Multitap_delay();
   ~Multitap_delay();
 
   void process(const ProcessArgs &args) override;
-  void onSampleRateChange() override;
+  void onSampleRateChange(const SampleRateChangeEvent &e) override;
+  void onPortChange(const PortChangeEvent &e) override;
 
+  // Shows the knobs of the current mode and publishes the state to the
+  // engine. Not for the audio thread.
   void updateKnobsFromState();
+  void updateKnobDisplay();
+  void publishParams();
+  void runWorker();
+  // Queues a pass of the worker. wakeWorker() may block briefly on the
+  // worker's mutex, tryWakeWorker() never does and is for process().
+  void wakeWorker();
+  void tryWakeWorker();
 
   json_t *dataToJson() override;
   void dataFromJson(json_t *rootJ) override;
@@ -15,7 +15,7 @@ public:
    * Processes input signal and applies panning.
    * @param pan Normalized pan value from -1.0 (Left) to 1.0 (Right).
    */
-  void process(float &left, float &right, float pan) {
+  template <typename T> void process(T &left, T &right, float pan) {
     // Normalize pan from [-1, 1] to [0, 1]
     float normalizedPan = (pan + 1.0f) * 0.5f;
 
@@ -35,6 +35,29 @@ public:
     left *= pL;
     right *= pR;
   }
+
+  /**
+   * Left and right gains for `pan`, with `gain` folded in.
+   */
+  static void gains(float pan, float gain, float &pL, float &pR) {
+    float angle = (pan + 1.0f) * 0.5f * (PI * 0.5f);
+    pL = std::cos(angle) * gain;
+    pR = std::sin(angle) * gain;
+  }
+
+  /**
+   * Block version of process(). The pan law is evaluated once per block.
+   */
+  template <typename T>
+  void processBlock(T *left, T *right, int frames, float pan,
+                    float gain = 1.0f) {
+    float pL, pR;
+    gains(pan, gain, pL, pR);
+    for (int i = 0; i < frames; i++) {
+      left[i] *= pL;
+      right[i] *= pR;
+    }
+  }
 };
 
 } // namespace paisa
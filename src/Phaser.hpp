@@ -1,4 +1,6 @@
 #pragma once
+#include "SimdSupport.hpp"
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <rack.hpp>
@@ -12,21 +14,21 @@ namespace paisa {
 /**
  * Pink Noise Generator (Paul Kellet's economy method)
  */
-class PinkNoise {
+template <typename T> class TPinkNoise {
 private:
-  float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f, b3 = 0.0f, b4 = 0.0f, b5 = 0.0f,
-        b6 = 0.0f;
+  T b0 = 0.0f, b1 = 0.0f, b2 = 0.0f, b3 = 0.0f, b4 = 0.0f, b5 = 0.0f,
+    b6 = 0.0f;
 
 public:
-  float process() {
-    float white = ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+  T process() {
+    T white = whiteNoise<T>();
     b0 = 0.99886f * b0 + white * 0.0555179f;
     b1 = 0.99332f * b1 + white * 0.0750759f;
     b2 = 0.96900f * b2 + white * 0.1538520f;
     b3 = 0.86650f * b3 + white * 0.3104856f;
     b4 = 0.55000f * b4 + white * 0.5329522f;
     b5 = -0.7616f * b5 - white * 0.0168980f;
-    float pink = b0 + b1 + b2 + b3 + b4 + b5 + b6 + white * 0.5362f;
+    T pink = b0 + b1 + b2 + b3 + b4 + b5 + b6 + white * 0.5362f;
     b6 = white * 0.115926f;
     return pink * 0.15f; // Normalized output
   }
@@ -36,140 +38,263 @@ public:
  * Single-pole Allpass filter
  * H(z) = (a + z^-1) / (1 + a * z^-1)
  */
-class PhaserAllpass {
+template <typename T> class TPhaserAllpass {
 private:
-  float z1 = 0.0f;
+  T z1 = 0.0f;
 
 public:
-  float process(float x, float a) {
-    float y = a * x + z1;
+  T process(T x, T a) {
+    T y = a * x + z1;
     z1 = x - a * y;
     return y;
   }
+  void flushDenormals() { z1 = flushDenormal(z1); }
+  void reset() { z1 = 0.0f; }
 };
 
+/**
+ * Allpass coefficient (1 - tan w) / (1 + tan w) for a corner at `freq` Hz,
+ * w = pi freq / sampleRate. That is tan(pi/4 - w). With the corner between
+ * 20 Hz and 0.45 sampleRate the argument stays within pi/4. There, tan() cut
+ * from its continued fraction is within 3e-6 of the exact coefficient.
+ */
+template <typename T> inline T phaserCoefficient(T freq, float sampleRate) {
+  T x = (float)(0.25 * M_PI) - ((float)M_PI / sampleRate) * freq;
+  T x2 = x * x;
+  return x * (105.0f - 10.0f * x2) / (105.0f - 45.0f * x2 + x2 * x2);
+}
+
 /**
  * 8-stage Phaser
  * Architecture inspired by classic analog phasers.
  * Uses a modulated allpass chain with feedback and stereo width.
+ * With T = float_4 every lane is a voice. P holds the knobs, the smoothing
+ * and the LFO: with P = float the lanes share them, with P = float_4 each
+ * lane of T = float_4 has its own, as the TapBank runs one tap per lane.
  */
-class Phaser {
+template <typename T, typename P = float> class TPhaser {
+public:
+  // Longest run of frames between two control rate updates
+  static constexpr int CONTROL_FRAMES = 16;
+
 private:
-  PhaserAllpass stagesL[12];
-  PhaserAllpass stagesR[12];
-  float feedbackL = 0.0f;
-  float feedbackR = 0.0f;
+  TPhaserAllpass<T> stagesL[12];
+  TPhaserAllpass<T> stagesR[12];
+  T feedbackL = 0.0f;
+  T feedbackR = 0.0f;
 
-  float lfoPhase = 0.0f;
-  float targetFreq = 1.0f;
-  float targetDepth = 0.5f;
-  float currentFreq = 1.0f;
-  float currentDepth = 0.5f;
+  P lfoPhase = 0.0f;
+  P targetFreq = 1.0f;
+  P targetDepth = 0.5f;
+  P currentFreq = 1.0f;
+  P currentDepth = 0.5f;
 
-  float targetNoiseGain = 0.0f;
-  float currentNoiseGain = 0.0f;
+  P targetNoiseGain = 0.0f;
+  P currentNoiseGain = 0.0f;
 
-  PinkNoise noiseL, noiseR;
+  TPinkNoise<T> noiseL, noiseR;
+  bool bypassed = false;
+
+  // Smoothing decay over 0 to CONTROL_FRAMES frames, per sample rate
+  float lastSampleRate = 0.0f;
+  float smoothDecay[CONTROL_FRAMES + 1];
+  // Allpass coefficients and mix gains at the end of the last control block,
+  // where the next one ramps from. Stale until primed.
+  P coeffL = 0.0f, coeffR = 0.0f;
+  P gainDry = 1.0f, gainWet = 0.0f;
+  bool primed = false;
 
 public:
+  // Smoothed depth under which the wet path is inaudible, below -120 dB,
+  // and gets cut off
+  static constexpr float DEPTH_EPSILON = 1e-3f;
   void setParams(float k1, float k2, float noiseGain = 0.0f) {
-    // K1: LFO Frequency (0.1Hz to 20Hz, Log scale)
-    targetFreq =
-        std::exp(std::log(0.1f) + k1 * (std::log(20.0f) - std::log(0.1f)));
+    targetFreq = lfoFrequency(k1);
     // K2: Depth (0.0 to 1.0)
     targetDepth = k2;
     targetNoiseGain = noiseGain;
   }
+  // The knobs of one lane, with P = float_4
+  void setParams(float k1, float k2, float noiseGain, int i) {
+    lane(targetFreq, i) = lfoFrequency(k1);
+    lane(targetDepth, i) = k2;
+    lane(targetNoiseGain, i) = noiseGain;
+  }
+
+  // K1: LFO Frequency (0.1Hz to 20Hz, Log scale)
+  static float lfoFrequency(float k1) {
+    return std::exp(std::log(0.1f) +
+                    k1 * (std::log(20.0f) - std::log(0.1f)));
+  }
+
+  // One frame, as processBlock()
+  void process(T &left, T &right, float sampleRate) {
+    processBlock(&left, &right, 1, sampleRate);
+  }
 
-  void process(float &left, float &right, float sampleRate) {
+  // At zero depth, once the depth has faded out, only the output clipper is
+  // left to run. The allpass chain is cleared then, so it fades back in
+  // from silence, and the LFO keeps its pace. With P = float_4 that waits
+  // for every lane.
+  void processBlock(T *left, T *right, int frames, float sampleRate) {
     if (sampleRate < 1.0f)
       return;
+    if (updateBypass()) {
+      lfoPhase += currentFreq * (float)frames / sampleRate;
+      lfoPhase -= rack::simd::floor(lfoPhase);
+      for (int i = 0; i < frames; i++) {
+        left[i] = sanitize(softClip(left[i]));
+        right[i] = sanitize(softClip(right[i]));
+      }
+      return;
+    }
+
+    if (std::abs(sampleRate - lastSampleRate) > 1.0f) {
+      // Parameter Smoothing
+      const float tau = 0.015f;
+      for (int n = 0; n <= CONTROL_FRAMES; n++)
+        smoothDecay[n] = std::exp(-(float)n / (tau * sampleRate));
+      lastSampleRate = sampleRate;
+      primed = false;
+    }
+    if (!primed) {
+      modulation(lfoPhase, currentDepth, sampleRate, coeffL, coeffR);
+      mixGains(currentDepth, gainDry, gainWet);
+      primed = true;
+    }
 
-    // Parameter Smoothing
-    const float tau = 0.015f;
-    float lambda = 1.0f - std::exp(-1.0f / (tau * sampleRate));
-    currentFreq += (targetFreq - currentFreq) * lambda;
-    currentDepth += (targetDepth - currentDepth) * lambda;
-    currentNoiseGain += (targetNoiseGain - currentNoiseGain) * lambda;
+    for (int offset = 0; offset < frames; offset += CONTROL_FRAMES) {
+      int n = std::min((int)CONTROL_FRAMES, frames - offset);
+      processControlBlock(left + offset, right + offset, n, sampleRate);
+    }
+    flushDenormals();
+  }
 
-    // LFO Update
-    lfoPhase += currentFreq / sampleRate;
-    while (lfoPhase > 1.0f)
-      lfoPhase -= 1.0f;
+  // Once per block, so the allpass chain decays to zero on silence
+  void flushDenormals() {
+    for (int i = 0; i < 12; i++) {
+      stagesL[i].flushDenormals();
+      stagesR[i].flushDenormals();
+    }
+    feedbackL = flushDenormal(feedbackL);
+    feedbackR = flushDenormal(feedbackR);
+  }
 
+private:
+  // Allpass coefficients at an LFO phase, left and right
+  static void modulation(P phase, P depth, float sampleRate, P &aL, P &aR) {
     // Modulation Range: up to 4 octaves
-    const float rangeOctaves = 4.0f * currentDepth;
+    P rangeOctaves = 4.0f * depth;
     const float f_base = 800.0f; // Center base frequency
-
-    // Left Channel LFO
-    float lfoL = std::sin(2.0f * M_PI * lfoPhase);
-    float fL = f_base * std::pow(2.0f, lfoL * rangeOctaves * 0.5f);
-    fL = rack::math::clamp(fL, 20.0f, sampleRate * 0.45f);
-    float tanL = std::tan(M_PI * fL / sampleRate);
-    float aL = (1.0f - tanL) / (1.0f + tanL);
+    // 2^x as exp(x ln 2), which float_4 has
+    const float ln2 = 0.69314718f;
 
     // Right Channel LFO (90 degree phase shift for stereo width)
-    float lfoR_val = std::sin(2.0f * M_PI * (lfoPhase + 0.25f));
-    float fR = f_base * std::pow(2.0f, lfoR_val * rangeOctaves * 0.5f);
-    fR = rack::math::clamp(fR, 20.0f, sampleRate * 0.45f);
-    float tanR = std::tan(M_PI * fR / sampleRate);
-    float aR = (1.0f - tanR) / (1.0f + tanR);
-
-    // Feedback Amount (increased for 12 stages, up to 0.94)
-    float fbAmount = 0.94f * currentDepth;
-
-    // Inject Noise scaled by Depth and Master Noise Gain
-    float noiseInject = currentNoiseGain * 0.4f;
-    float nL = noiseL.process() * noiseInject;
-    float nR = noiseR.process() * noiseInject;
-
-    // Process Left
-    float fbL = feedbackL * fbAmount;
-    float inL = left + fbL + nL;
-    float wetL = inL;
-    for (int i = 0; i < 12; i++) {
-      wetL = stagesL[i].process(wetL, aL);
+    P angle = 2.0f * (float)M_PI * phase;
+    P fL = f_base *
+           rack::simd::exp(rack::simd::sin(angle) * rangeOctaves * 0.5f * ln2);
+    P fR = f_base *
+           rack::simd::exp(rack::simd::cos(angle) * rangeOctaves * 0.5f * ln2);
+    P fMin = 20.0f;
+    P fMax = sampleRate * 0.45f;
+    fL = rack::simd::fmin(rack::simd::fmax(fL, fMin), fMax);
+    fR = rack::simd::fmin(rack::simd::fmax(fR, fMin), fMax);
+    aL = phaserCoefficient(fL, sampleRate);
+    aR = phaserCoefficient(fR, sampleRate);
+  }
+
+  // Log-scale mapping for Dry/Wet mix to provide more resolution in the
+  // useful phasing range Mix maps from 100% dry to 50/50 mix (max
+  // cancellation)
+  static void mixGains(P depth, P &gDry, P &gWet) {
+    P mixTaper = depth * depth; // Simple quadratic log-like taper
+    P mixRatio = mixTaper * 0.5f;
+    P theta = ((float)M_PI * 0.5f) * mixRatio;
+    gDry = rack::simd::cos(theta);
+    gWet = rack::simd::sin(theta);
+  }
+
+  // The smoothing, LFO, allpass coefficients and mix gains run once per
+  // control block, up to CONTROL_FRAMES long, and ramp linearly to their
+  // values at its end
+  void processControlBlock(T *left, T *right, int frames, float sampleRate) {
+    float decay = smoothDecay[frames];
+    P freq = targetFreq + (currentFreq - targetFreq) * decay;
+    P depth = targetDepth + (currentDepth - targetDepth) * decay;
+    P noiseGain =
+        targetNoiseGain + (currentNoiseGain - targetNoiseGain) * decay;
+
+    // LFO Update, at the frequency halfway through the block
+    lfoPhase += 0.5f * (currentFreq + freq) * (float)frames / sampleRate;
+    lfoPhase -= rack::simd::floor(lfoPhase);
+
+    P aLEnd, aREnd, dryEnd, wetEnd;
+    modulation(lfoPhase, depth, sampleRate, aLEnd, aREnd);
+    mixGains(depth, dryEnd, wetEnd);
+
+    float step = 1.0f / (float)frames;
+    for (int i = 0; i < frames; i++) {
+      float t = (float)(i + 1) * step;
+      P aL = coeffL + (aLEnd - coeffL) * t;
+      P aR = coeffR + (aREnd - coeffR) * t;
+      P gDry = gainDry + (dryEnd - gainDry) * t;
+      P gWet = gainWet + (wetEnd - gainWet) * t;
+
+      // Feedback Amount (increased for 12 stages, up to 0.94)
+      P fbAmount = 0.94f * (currentDepth + (depth - currentDepth) * t);
+
+      // Inject Noise scaled by Depth and Master Noise Gain
+      P noiseInject =
+          0.4f * (currentNoiseGain + (noiseGain - currentNoiseGain) * t);
+      T nL = noiseL.process() * noiseInject;
+      T nR = noiseR.process() * noiseInject;
+
+      // Process Left
+      T wetL = left[i] + feedbackL * fbAmount + nL;
+      for (int s = 0; s < 12; s++)
+        wetL = stagesL[s].process(wetL, aL);
+      feedbackL = wetL;
+
+      // Process Right
+      T wetR = right[i] + feedbackR * fbAmount + nR;
+      for (int s = 0; s < 12; s++)
+        wetR = stagesR[s].process(wetR, aR);
+      feedbackR = wetR;
+
+      // Soft-clipping for stability with feedback
+      left[i] = sanitize(softClip(gDry * left[i] + gWet * wetL));
+      right[i] = sanitize(softClip(gDry * right[i] + gWet * wetR));
     }
-    feedbackL = wetL;
+    currentFreq = freq;
+    currentDepth = depth;
+    currentNoiseGain = noiseGain;
+    coeffL = aLEnd;
+    coeffR = aREnd;
+    gainDry = dryEnd;
+    gainWet = wetEnd;
+  }
 
-    // Process Right
-    float fbR = feedbackR * fbAmount;
-    float inR = right + fbR + nR;
-    float wetR = inR;
-    for (int i = 0; i < 12; i++) {
-      wetR = stagesR[i].process(wetR, aR);
+  bool updateBypass() {
+    bool idle = allZero(targetDepth) && allBelow(currentDepth, DEPTH_EPSILON);
+    if (idle && !bypassed) {
+      for (int i = 0; i < 12; i++) {
+        stagesL[i].reset();
+        stagesR[i].reset();
+      }
+      feedbackL = feedbackR = 0.0f;
     }
-    feedbackR = wetR;
-
-    // Log-scale mapping for Dry/Wet mix to provide more resolution in the
-    // useful phasing range Mix maps from 100% dry to 50/50 mix (max
-    // cancellation)
-    float mixTaper =
-        currentDepth * currentDepth; // Simple quadratic log-like taper
-    float mixRatio = mixTaper * 0.5f;
-    float theta = (M_PI * 0.5f) * mixRatio;
-    float gDry = std::cos(theta);
-    float gWet = std::sin(theta);
-
-    float outL = gDry * left + gWet * wetL;
-    float outR = gDry * right + gWet * wetR;
-
-    // Soft-clipping for stability with feedback
-    float limit = 0.95f;
-    for (float *s : {&outL, &outR}) {
-      if (*s > limit)
-        *s = limit + (1.0f - limit) * std::tanh((*s - limit) / (1.0f - limit));
-      else if (*s < -limit)
-        *s =
-            -limit - (1.0f - limit) * std::tanh((-*s - limit) / (1.0f - limit));
-
-      if (!std::isfinite(*s))
-        *s = 0.0f;
+    if (idle) {
+      primed = false;
+      // Nothing smooths while bypassed, so the rest starts from its target
+      currentDepth = 0.0f;
+      currentFreq = targetFreq;
+      currentNoiseGain = targetNoiseGain;
     }
-
-    left = outL;
-    right = outR;
+    bypassed = idle;
+    return bypassed;
   }
 };
 
+typedef TPhaser<float> Phaser;
+
 } // namespace paisa
@@ -1,14 +1,72 @@
 #pragma once
+#include <algorithm>
 #include <rack.hpp>
 
 namespace paisa {
 
-class Processor {
+// T is float, or rack::simd::float_4 for four polyphonic voices at once
+template <typename T> class TProcessor {
 public:
-  virtual ~Processor() = default;
-  virtual void process(float &left, float &right, float sampleRate) = 0;
+  virtual ~TProcessor() = default;
+  virtual void process(T &left, T &right, float sampleRate) = 0;
+  // Processes a contiguous block of frames in place. Stages override this
+  // with a tight loop so the per-sample virtual dispatch goes away.
+  virtual void processBlock(T *left, T *right, int frames, float sampleRate) {
+    for (int i = 0; i < frames; i++)
+      process(left[i], right[i], sampleRate);
+  }
   virtual void setParams(float p1, float p2) = 0;
   virtual void setParams(float p1, float p2, float p3) {}
 };
 
+/**
+ * Takes a stage out of the signal path while it would only pass its input
+ * through, so its blocks can be skipped. Switching it back in, or out,
+ * crossfades between its input and its output over FADE_TIME.
+ */
+class StageBypass {
+public:
+  static constexpr float FADE_TIME = 0.005f;
+
+  // Once per block, with whether the stage is an identity for it. False
+  // when the stage can be skipped. `wake` is set when the stage comes back
+  // into the path, still holding the state it had when it left.
+  bool begin(bool identity, float sampleRate, bool &wake) {
+    wake = !identity && gain == 0.f;
+    target = identity ? 0.f : 1.f;
+    step = 1.f / std::max(1.f, FADE_TIME * sampleRate);
+    return gain > 0.f || target > 0.f;
+  }
+
+  // Runs `stage` over one channel of the block in place, mixed with its
+  // input while fading. Every channel sees the same fade, then end().
+  template <typename T, typename F>
+  void run(T *x, int frames, F stage) const {
+    if (gain == target) {
+      for (int i = 0; i < frames; i++)
+        x[i] = stage(x[i]);
+      return;
+    }
+    float g = gain;
+    for (int i = 0; i < frames; i++) {
+      g = next(g, step);
+      T y = stage(x[i]);
+      x[i] += (y - x[i]) * g;
+    }
+  }
+
+  void end(int frames) { gain = next(gain, step * (float)frames); }
+
+private:
+  float gain = 1.f; // 0 out of the path, 1 in it
+  float target = 1.f;
+  float step = 0.f;
+
+  float next(float g, float by) const {
+    return target > g ? std::min(target, g + by) : std::max(target, g - by);
+  }
+};
+
+typedef TProcessor<float> Processor;
+
 } // namespace paisa
@@ -154,6 +154,12 @@ public:
     left = dryL + currentMix * dcBlockerL.process(branchL);
     right = dryR + currentMix * dcBlockerR.process(branchR);
   }
+
+  // Once per block. The allpass stages flush their own writes.
+  void flushDenormals() {
+    dcBlockerL.flushDenormals();
+    dcBlockerR.flushDenormals();
+  }
 };
 
 } // namespace paisa
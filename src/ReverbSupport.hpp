@@ -1,4 +1,5 @@
 #pragma once
+#include "Denormals.hpp"
 #include <algorithm>
 #include <vector>
 
@@ -40,9 +41,10 @@ public:
     // Which is y = g*x + delayed; buffer[w] = x - g*y;
     float y = g * x + delayed;
 
-    // Apply damping (low-pass) to the internal feedback signal
+    // Apply damping (low-pass) to the internal feedback signal. Flushed on
+    // every write, since the buffer holds the state of the loop.
     float feedbackSignal = x - g * y;
-    lp = feedbackSignal * (1.0f - damping) + lp * damping;
+    lp = flushDenormal(feedbackSignal * (1.0f - damping) + lp * damping);
     buffer[writeIndex] = lp;
 
     writeIndex = (writeIndex + 1) % buffer.size();
@@ -63,6 +65,11 @@ public:
     y_z1 = y;
     return y;
   }
+  // Once per block, so a silent input decays to zero
+  void flushDenormals() {
+    x_z1 = flushDenormal(x_z1);
+    y_z1 = flushDenormal(y_z1);
+  }
 };
 
 } // namespace paisa
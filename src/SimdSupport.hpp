@@ -0,0 +1,90 @@
+#pragma once
+#include "Denormals.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <rack.hpp>
+
+namespace paisa {
+
+/**
+ * Helpers that let the same DSP code run on plain floats and on
+ * rack::simd::float_4, where every lane carries one polyphonic voice.
+ * The float overloads keep the exact arithmetic the stages always used.
+ */
+typedef rack::simd::float_4 float_4;
+
+// Zero for NaN and infinity, lane by lane
+inline float sanitize(float x) { return std::isfinite(x) ? x : 0.0f; }
+inline float_4 sanitize(float_4 x) {
+  return rack::simd::ifelse(rack::simd::fabs(x) < INFINITY, x, 0.0f);
+}
+
+// Zero below DENORMAL_THRESHOLD, lane by lane
+inline float_4 flushDenormal(float_4 x) {
+  return rack::simd::ifelse(rack::simd::fabs(x) < DENORMAL_THRESHOLD, 0.0f,
+                            x);
+}
+
+// Lane `i` of a setting held either as one float for every lane, or per
+// lane as a float_4
+inline float &lane(float &x, int) { return x; }
+inline float &lane(float_4 &x, int i) { return x[i]; }
+
+// Whether every lane is zero, or below `limit` in magnitude
+inline bool allZero(float x) { return x == 0.0f; }
+inline bool allZero(float_4 x) {
+  return x[0] == 0.0f && x[1] == 0.0f && x[2] == 0.0f && x[3] == 0.0f;
+}
+inline bool allBelow(float x, float limit) { return std::fabs(x) < limit; }
+inline bool allBelow(float_4 x, float limit) {
+  float_4 a = rack::simd::fabs(x);
+  return a[0] < limit && a[1] < limit && a[2] < limit && a[3] < limit;
+}
+
+// Padé approximant of tanh, held at +-1 past |x| = 4.97 where it gets
+// there. Within 1e-4 of std::tanh, with one division and no exp().
+inline float fastTanh(float x) {
+  x = rack::math::clamp(x, -4.97f, 4.97f);
+  float x2 = x * x;
+  return x * (135135.f + x2 * (17325.f + x2 * (378.f + x2))) /
+         (135135.f + x2 * (62370.f + x2 * (3150.f + 28.f * x2)));
+}
+inline float_4 fastTanh(float_4 x) {
+  x = rack::simd::clamp(x, -4.97f, 4.97f);
+  float_4 x2 = x * x;
+  return x * (135135.f + x2 * (17325.f + x2 * (378.f + x2))) /
+         (135135.f + x2 * (62370.f + x2 * (3150.f + 28.f * x2)));
+}
+
+// Transparent up to 0.95, then a tanh knee towards 1. NaN passes through
+// for sanitize().
+inline float softClip(float x) {
+  const float limit = 0.95f;
+  float a = std::fabs(x);
+  if (!(a > limit))
+    return x;
+  float knee = limit + (1.0f - limit) * fastTanh((a - limit) / (1.0f - limit));
+  return std::copysign(knee, x);
+}
+inline float_4 softClip(float_4 x) {
+  const float limit = 0.95f;
+  float_4 a = rack::simd::fabs(x);
+  float_4 knee =
+      limit + (1.0f - limit) * fastTanh((a - limit) / (1.0f - limit));
+  knee = rack::simd::ifelse(x < 0.0f, -knee, knee);
+  return rack::simd::ifelse(a > limit, knee, x);
+}
+
+// Uniform white noise in [-1, 1], independent per lane
+template <typename T> T whiteNoise();
+template <> inline float whiteNoise<float>() {
+  return ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+}
+template <> inline float_4 whiteNoise<float_4>() {
+  float_4 w;
+  for (int i = 0; i < 4; i++)
+    w[i] = whiteNoise<float>();
+  return w;
+}
+
+} // namespace paisa
@@ -3,15 +3,16 @@
 
 namespace paisa {
 
-Tap::Tap(size_t bufferSize) {
-  delay = std::unique_ptr<DelayProcessor>(new DelayProcessor(bufferSize));
-  filter = std::unique_ptr<FilterProcessor>(new FilterProcessor());
-  amppan = std::unique_ptr<AmpPanProcessor>(new AmpPanProcessor());
-  fx1 = std::unique_ptr<FX1Processor>(new FX1Processor());
-  fx2 = std::unique_ptr<FX2Processor>(new FX2Processor());
+template <typename T> TTap<T>::TTap(size_t bufferSize) {
+  delay = std::unique_ptr<TDelayProcessor<T>>(
+      new TDelayProcessor<T>(bufferSize));
+  filter = std::unique_ptr<TFilterProcessor<T>>(new TFilterProcessor<T>());
+  amppan = std::unique_ptr<TAmpPanProcessor<T>>(new TAmpPanProcessor<T>());
+  fx1 = std::unique_ptr<TFX1Processor<T>>(new TFX1Processor<T>());
+  fx2 = std::unique_ptr<TFX2Processor<T>>(new TFX2Processor<T>());
 }
 
-void Tap::setParam(int mode, float p1, float p2) {
+template <typename T> void TTap<T>::setParam(int mode, float p1, float p2) {
   switch (mode) {
   case Multitap_delay::MODE_DELAY:
     delay->setParams(p1, p2);
@@ -31,34 +32,64 @@ void Tap::setParam(int mode, float p1, float p2) {
   }
 }
 
-void Tap::setFX2Params(float p1, float p2, float p3) {
+template <typename T>
+void TTap<T>::setFX2Params(float p1, float p2, float p3) {
   fx2->setParams(p1, p2, p3);
 }
 
-void Tap::process(float inL, float inR, float &outL, float &outR,
-                  float sampleRate) {
-  // 1. Read from independent delay line
-  float tapL, tapR;
-  delay->read(tapL, tapR, sampleRate);
+template <typename T>
+void TTap<T>::process(T inL, T inR, T &outL, T &outR, float sampleRate) {
+  processBlock(&inL, &inR, &outL, &outR, 1, sampleRate);
+}
+
+template <typename T>
+void TTap<T>::processBlock(const T *inL, const T *inR, T *outL, T *outR,
+                           int frames, float sampleRate) {
+  int offset = 0;
+  while (offset < frames) {
+    // A sub-block can't be longer than the delay itself, otherwise the read
+    // head would reach frames this sub-block has not written back yet. The
+    // shifter only delays the signal while it isn't bypassed.
+    delay->setLatency(fx1->getLatency());
+    int n = std::min(frames - offset, delay->getCausalFrames(sampleRate));
+    T *l = outL + offset;
+    T *r = outR + offset;
 
-  // 2. Head through the processing chain (Filter -> AmpPan -> FX)
-  outL = tapL;
-  outR = tapR;
+    // 1. Read from independent delay line
+    delay->readBlock(l, r, n, sampleRate);
 
-  filter->process(outL, outR, sampleRate);
-  amppan->process(outL, outR, sampleRate);
-  fx1->process(outL, outR, sampleRate);
-  fx2->process(outL, outR, sampleRate);
+    // 2. Head through the processing chain (Filter -> AmpPan -> FX)
+    processChain(l, r, n, sampleRate);
 
-  // 3. Feedback: The end of the chain is fed back to the delay input
-  float feedbackGain = delay->getFeedbackAmount();
+    // 3. Feedback: The end of the chain is fed back to the delay input
+    float feedbackGain = delay->getFeedbackAmount();
 
-  // Mix input with feedback
-  float fbL = inL + outL * feedbackGain;
-  float fbR = inR + outR * feedbackGain;
+    // 4. Mix input with feedback and write back to the independent delay
+    // line. Flushed on the way in, since the line is itself a feedback loop.
+    for (int i = 0; i < n; i++) {
+      delay->write(flushDenormal(inL[offset + i] + l[i] * feedbackGain),
+                   flushDenormal(inR[offset + i] + r[i] * feedbackGain));
+    }
+    offset += n;
+  }
+}
 
-  // 4. Write back to the independent delay line
-  delay->write(fbL, fbR);
+template <typename T>
+void TTap<T>::processBlockShared(const TDelayLine<T> &line, T *outL, T *outR,
+                                 int frames, float sampleRate) {
+  delay->readBlock(line, outL, outR, frames, sampleRate);
+  processChain(outL, outR, frames, sampleRate);
 }
 
+template <typename T>
+void TTap<T>::processChain(T *left, T *right, int frames, float sampleRate) {
+  filter->processBlock(left, right, frames, sampleRate);
+  amppan->processBlock(left, right, frames, sampleRate);
+  fx1->processBlock(left, right, frames, sampleRate);
+  fx2->processBlock(left, right, frames, sampleRate);
+}
+
+template class TTap<float>;
+template class TTap<float_4>;
+
 } // namespace paisa
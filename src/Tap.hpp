@@ -8,20 +8,55 @@
 
 namespace paisa {
 
-class Tap {
-  std::unique_ptr<DelayProcessor> delay;
-  std::unique_ptr<FilterProcessor> filter;
-  std::unique_ptr<AmpPanProcessor> amppan;
-  std::unique_ptr<FX1Processor> fx1;
-  std::unique_ptr<FX2Processor> fx2;
+/**
+ * One delay tap and its processing chain. T is float, or rack::simd::float_4
+ * to run four polyphonic voices with the same settings.
+ */
+template <typename T> class TTap {
+  std::unique_ptr<TDelayProcessor<T>> delay;
+  std::unique_ptr<TFilterProcessor<T>> filter;
+  std::unique_ptr<TAmpPanProcessor<T>> amppan;
+  std::unique_ptr<TFX1Processor<T>> fx1;
+  std::unique_ptr<TFX2Processor<T>> fx2;
+
+  void processChain(T *left, T *right, int frames, float sampleRate);
 
 public:
-  Tap(size_t bufferSize);
+  TTap(size_t bufferSize);
 
   void setParam(int mode, float p1, float p2);
   void setFX2Params(float p1, float p2, float p3);
-  void process(float inL, float inR, float &outL, float &outR,
-               float sampleRate);
+  void setInterpolation(int mode) { delay->setInterpolation(mode); }
+  // Hilbert transformer of the shifter. Its latency is taken off the delay
+  // time while the shifter isn't bypassed.
+  void setHilbert(int mode) { fx1->setHilbert(mode); }
+  void setShifterStereo(int mode) { fx1->setStereo(mode); }
+  void setGlide(int mode, float seconds) { delay->setGlide(mode, seconds); }
+  void setTimeModulation(float amount) { delay->setTimeModulation(amount); }
+  void setModulated(bool on) { delay->setModulated(on); }
+  // Grows the delay memory for the current delay time. Not for the audio
+  // thread.
+  void reserve(float sampleRate) { delay->reserve(sampleRate); }
+  void reserveFrames(size_t frames) { delay->reserveFrames(frames); }
+  size_t getRequiredFrames(float sampleRate) const {
+    return delay->getRequiredFrames(sampleRate);
+  }
+  size_t getMemoryFrames() const { return delay->getMemoryFrames(); }
+  void process(T inL, T inR, T &outL, T &outR, float sampleRate);
+  void processBlock(const T *inL, const T *inR, T *outL, T *outR, int frames,
+                    float sampleRate);
+
+  // Shared line mode: the tap is only a read head on `line`. The caller
+  // writes the line and mixes in getFeedbackAmount() of every tap output.
+  int getCausalFrames(const TDelayLine<T> &line, float sampleRate) {
+    delay->setLatency(fx1->getLatency());
+    return delay->getCausalFrames(line, sampleRate);
+  }
+  float getFeedbackAmount() const { return delay->getFeedbackAmount(); }
+  void processBlockShared(const TDelayLine<T> &line, T *outL, T *outR,
+                          int frames, float sampleRate);
 };
 
+typedef TTap<float> Tap;
+
 } // namespace paisa
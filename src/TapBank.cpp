@@ -0,0 +1,217 @@
+#include "TapBank.hpp"
+#include "AmpPanProcessor.hpp"
+#include "FilterProcessor.hpp"
+#include "Multitap_delay.hpp"
+#include "Panner.hpp"
+
+namespace paisa {
+
+// Copies the coefficients of a scalar filter into one lane
+static void setLane(TSVF<float_4, float_4> &dst, int lane, const SVF &src) {
+  dst.g[lane] = src.g;
+  dst.k[lane] = src.k;
+  dst.a1[lane] = src.a1;
+  dst.a2[lane] = src.a2;
+  dst.a3[lane] = src.a3;
+}
+
+TapBank::TapBank(size_t maxDelayFrames) {
+  for (int t = 0; t < NUM_TAPS; t++) {
+    delays[t] = std::unique_ptr<DelayProcessor>(
+        new DelayProcessor(maxDelayFrames));
+    filter.p1[t] = filter.p2[t] = 0.5f;
+    amppan.p1[t] = amppan.p2[t] = 0.5f;
+  }
+}
+
+void TapBank::setParam(int tap, int mode, float p1, float p2) {
+  switch (mode) {
+  case Multitap_delay::MODE_DELAY:
+    delays[tap]->setParams(p1, p2);
+    break;
+  case Multitap_delay::MODE_AMP_PAN:
+    if (p1 != amppan.p1[tap] || p2 != amppan.p2[tap]) {
+      amppan.p1[tap] = p1;
+      amppan.p2[tap] = p2;
+      amppan.dirty = true;
+    }
+    break;
+  case Multitap_delay::MODE_FILTER:
+    if (p1 != filter.p1[tap] || p2 != filter.p2[tap]) {
+      filter.p1[tap] = p1;
+      filter.p2[tap] = p2;
+      filter.dirty = true;
+    }
+    break;
+  case Multitap_delay::MODE_FX1:
+    shifter.setParams(p1, p2, tap);
+    break;
+  case Multitap_delay::MODE_FX2:
+    // Like Phaser::setParams() with two knobs, the noise goes back to 0
+    setFX2Params(tap, p1, p2, 0.f);
+    break;
+  }
+}
+
+void TapBank::setFX2Params(int tap, float p1, float p2, float p3) {
+  phaser.setParams(p1, p2, p3, tap);
+}
+
+void TapBank::setInterpolation(int mode) {
+  for (auto &delay : delays)
+    delay->setInterpolation(mode);
+}
+
+void TapBank::setHilbert(int mode) { shifter.setHilbert(mode); }
+
+void TapBank::setShifterStereo(int mode) { shifter.setStereo(mode); }
+
+void TapBank::setGlide(int mode, float seconds) {
+  for (auto &delay : delays)
+    delay->setGlide(mode, seconds);
+}
+
+void TapBank::reserve(float sampleRate) {
+  for (auto &delay : delays)
+    delay->reserve(sampleRate);
+}
+
+void TapBank::processBlock(const float *inL, const float *inR, float_4 *outL,
+                           float_4 *outR, int frames, float sampleRate) {
+  int offset = 0;
+  while (offset < frames) {
+    // The lanes move together, so the shortest delay sets the sub-block.
+    // The shifter only delays the signal while it isn't bypassed.
+    int n = std::min(frames - offset, (int)MAX_FRAMES);
+    int latency = shifter.getLatency();
+    for (auto &delay : delays) {
+      delay->setLatency(latency);
+      n = std::min(n, delay->getCausalFrames(sampleRate));
+    }
+
+    for (int t = 0; t < NUM_TAPS; t++)
+      delays[t]->readBlock(readL[t], readR[t], n, sampleRate);
+    float_4 *l = outL + offset;
+    float_4 *r = outR + offset;
+    gather(l, r, n);
+    processChain(l, r, n, sampleRate);
+
+    for (int t = 0; t < NUM_TAPS; t++) {
+      float feedbackGain = delays[t]->getFeedbackAmount();
+      for (int i = 0; i < n; i++) {
+        delays[t]->write(
+            flushDenormal(inL[offset + i] + l[i][t] * feedbackGain),
+            flushDenormal(inR[offset + i] + r[i][t] * feedbackGain));
+      }
+    }
+    offset += n;
+  }
+}
+
+void TapBank::processBlockShared(DelayLine &shared, const float *inL,
+                                 const float *inR, float_4 *outL,
+                                 float_4 *outR, int frames,
+                                 float sampleRate) {
+  shared.commit();
+  int offset = 0;
+  while (offset < frames) {
+    int n = std::min(frames - offset, (int)MAX_FRAMES);
+    int latency = shifter.getLatency();
+    for (auto &delay : delays) {
+      delay->setLatency(latency);
+      n = std::min(n, delay->getCausalFrames(shared, sampleRate));
+    }
+
+    for (int t = 0; t < NUM_TAPS; t++)
+      delays[t]->readBlock(shared, readL[t], readR[t], n, sampleRate);
+    float_4 *l = outL + offset;
+    float_4 *r = outR + offset;
+    gather(l, r, n);
+    processChain(l, r, n, sampleRate);
+
+    float feedback[NUM_TAPS];
+    for (int t = 0; t < NUM_TAPS; t++)
+      feedback[t] = delays[t]->getFeedbackAmount();
+    for (int i = 0; i < n; i++) {
+      float sumL = inL[offset + i];
+      float sumR = inR[offset + i];
+      for (int t = 0; t < NUM_TAPS; t++) {
+        sumL += l[i][t] * feedback[t];
+        sumR += r[i][t] * feedback[t];
+      }
+      shared.write(flushDenormal(sumL), flushDenormal(sumR));
+    }
+    offset += n;
+  }
+}
+
+void TapBank::gather(float_4 *outL, float_4 *outR, int frames) const {
+  for (int i = 0; i < frames; i++) {
+    outL[i] = float_4(readL[0][i], readL[1][i], readL[2][i], readL[3][i]);
+    outR[i] = float_4(readR[0][i], readR[1][i], readR[2][i], readR[3][i]);
+  }
+}
+
+void TapBank::processChain(float_4 *left, float_4 *right, int frames,
+                           float sampleRate) {
+  processFilter(left, right, frames, sampleRate);
+  processAmpPan(left, right, frames);
+  shifter.processBlock(left, right, frames, sampleRate);
+  phaser.processBlock(left, right, frames, sampleRate);
+}
+
+void TapBank::processFilter(float_4 *left, float_4 *right, int frames,
+                            float sampleRate) {
+  if (filter.dirty || sampleRate != filter.lastSampleRate) {
+    for (int t = 0; t < NUM_TAPS; t++) {
+      float f, w;
+      FilterProcessor::mapParams(filter.p1[t], filter.p2[t], f, w);
+      BaseWidthFilter lane;
+      lane.setParams(sampleRate, f, w);
+      setLane(filter.l.hp_filter, t, lane.hp_filter);
+      setLane(filter.l.lp_filter, t, lane.lp_filter);
+      setLane(filter.r.hp_filter, t, lane.hp_filter);
+      setLane(filter.r.lp_filter, t, lane.lp_filter);
+    }
+    filter.neutral = true;
+    for (int t = 0; t < NUM_TAPS; t++) {
+      filter.neutral = filter.neutral &&
+                       FilterProcessor::isNeutral(filter.p1[t], filter.p2[t]);
+    }
+    filter.lastSampleRate = sampleRate;
+    filter.dirty = false;
+  }
+  bool wake;
+  if (!filter.bypass.begin(filter.neutral, sampleRate, wake))
+    return;
+  if (wake) {
+    filter.l.reset();
+    filter.r.reset();
+  }
+  filter.bypass.run(left, frames,
+                    [&](float_4 x) { return filter.l.process(x); });
+  filter.bypass.run(right, frames,
+                    [&](float_4 x) { return filter.r.process(x); });
+  filter.bypass.end(frames);
+  filter.l.flushDenormals();
+  filter.r.flushDenormals();
+}
+
+void TapBank::processAmpPan(float_4 *left, float_4 *right, int frames) {
+  if (amppan.dirty) {
+    for (int t = 0; t < NUM_TAPS; t++) {
+      float gain, pan, pL, pR;
+      AmpPanProcessor::mapParams(amppan.p1[t], amppan.p2[t], gain, pan);
+      Panner::gains(pan, gain, pL, pR);
+      amppan.gainL[t] = pL;
+      amppan.gainR[t] = pR;
+    }
+    amppan.dirty = false;
+  }
+  for (int i = 0; i < frames; i++) {
+    left[i] *= amppan.gainL;
+    right[i] *= amppan.gainR;
+  }
+}
+
+} // namespace paisa
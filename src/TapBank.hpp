@@ -0,0 +1,89 @@
+#pragma once
+#include "DelayProcessor.hpp"
+#include "Filter.hpp"
+#include "FrequencyShifter.hpp"
+#include "Phaser.hpp"
+#include "SimdSupport.hpp"
+#include <memory>
+
+namespace paisa {
+
+/**
+ * The four taps of a single voice, laid out as structure of arrays: every
+ * float_4 holds the same value for the four taps, one per lane, so the
+ * filter, amp/pan, shifter and phaser run one SIMD pass for all of them.
+ * Only the delay lines stay separate, since each has its own length, and
+ * their reads are gathered into the lanes.
+ * Same chain and feedback routing as four TTap<float>.
+ */
+class TapBank {
+public:
+  static constexpr int NUM_TAPS = 4;
+
+  TapBank(size_t maxDelayFrames);
+
+  void setParam(int tap, int mode, float p1, float p2);
+  void setFX2Params(int tap, float p1, float p2, float p3);
+  void setInterpolation(int mode);
+  // As TTap::setHilbert(), for the four taps
+  void setHilbert(int mode);
+  // As TTap::setShifterStereo(), for the four taps
+  void setShifterStereo(int mode);
+  void setGlide(int mode, float seconds);
+  void setTimeModulation(int tap, float amount) {
+    delays[tap]->setTimeModulation(amount);
+  }
+
+  // Grows the delay memory of every tap for its current delay time, or of
+  // one tap to `frames`. Not for the audio thread.
+  void reserve(float sampleRate);
+  void reserve(int tap, size_t frames) { delays[tap]->reserveFrames(frames); }
+
+  // Independent lines: each tap feeds back into its own delay line. Lane t
+  // of the outputs is tap t.
+  void processBlock(const float *inL, const float *inR, float_4 *outL,
+                    float_4 *outR, int frames, float sampleRate);
+  // Shared line: the taps read `shared`, and the input plus the summed
+  // feedback is written to it once per frame.
+  void processBlockShared(DelayLine &shared, const float *inL,
+                          const float *inR, float_4 *outL, float_4 *outR,
+                          int frames, float sampleRate);
+
+private:
+  static constexpr int MAX_FRAMES = 64;
+
+  struct FilterLanes {
+    TBaseWidthFilter<float_4, float_4> l, r;
+    float p1[NUM_TAPS], p2[NUM_TAPS];
+    float lastSampleRate = -1.f;
+    bool dirty = true;
+    bool neutral = false; // Every tap at FilterProcessor::isNeutral()
+    StageBypass bypass;
+  };
+
+  struct AmpPanLanes {
+    float p1[NUM_TAPS], p2[NUM_TAPS];
+    float_4 gainL = 0.f, gainR = 0.f;
+    bool dirty = true;
+  };
+
+  std::unique_ptr<DelayProcessor> delays[NUM_TAPS];
+  FilterLanes filter;
+  AmpPanLanes amppan;
+  // One knob setting, oscillator and LFO per lane
+  TFrequencyShifter<float_4, float_4> shifter;
+  TPhaser<float_4, float_4> phaser;
+
+  // One row per tap, as the delay processors read them
+  float readL[NUM_TAPS][MAX_FRAMES];
+  float readR[NUM_TAPS][MAX_FRAMES];
+
+  void gather(float_4 *outL, float_4 *outR, int frames) const;
+  void processChain(float_4 *left, float_4 *right, int frames,
+                    float sampleRate);
+  void processFilter(float_4 *left, float_4 *right, int frames,
+                     float sampleRate);
+  void processAmpPan(float_4 *left, float_4 *right, int frames);
+};
+
+} // namespace paisa
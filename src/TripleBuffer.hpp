@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+
+namespace paisa {
+
+/**
+ * Lock-free handoff of a value from one producer thread to one consumer
+ * thread. The producer fills write() and publish()es it, the consumer calls
+ * update() and then reads read(). Each side owns one of the three slots and
+ * the third sits in the middle, so neither side ever waits or sees a
+ * half-written value. Values published faster than they are consumed are
+ * skipped, and only the latest one is seen.
+ */
+template <typename T> class TripleBuffer {
+  static constexpr int FRESH = 4; // Set in `middle` once it holds new data
+
+  T slots[3];
+  int back = 0;  // Producer's slot
+  int front = 2; // Consumer's slot
+  // Padded to its own cache line, so the consumer's polling doesn't share
+  // one with the data. Not alignas(), which plain new ignores in C++11.
+  char before[64];
+  std::atomic<int> middle{1};
+  char after[64];
+
+public:
+  // Producer: the slot to fill before publish()
+  T &write() { return slots[back]; }
+
+  // Producer: hands the filled slot over and takes the middle one
+  void publish() {
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+  }
+
+  // Consumer: takes the latest published value, if there is a new one
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+    return true;
+  }
+
+  // Consumer: the value taken by the last successful update()
+  const T &read() const { return slots[front]; }
+};
+
+} // namespace paisa